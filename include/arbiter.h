@@ -0,0 +1,75 @@
+#ifndef ARBITER_H
+#define ARBITER_H
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 29-3-2021
+* File : arbiter.h
+* The timers, the rules and the REST calls do not switch the devices
+* themselves, they request a state. Once per tick the request with the
+* highest priority decides the state of each device.
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <stdint.h>
+#include <TimeLib.h>
+
+/*****************
+    Defines
+******************/
+// Sources of requests, a lower number has a higher priority
+#define ARB_NONE          -1  // no request, the device is off
+#define ARB_MANUAL         0  // PUT /device/{device}/on, /on/{period} and /off, see arb_request
+#define ARB_SPRAYER        1  // the actions of the sprayer rule
+#define ARB_TIMER          2
+#define ARB_RULE           3  // the temperature rules
+#define ARB_NR_OF_SOURCES  4
+
+/*****************
+    Structs
+******************/
+
+/*************************
+    Function templates
+*************************/
+void arb_init();
+/*
+* Request a state for the device, it replaces the former request of the source.
+* end_time is like Device.end_time: 0 = off, -1 = on, -2 = on until the ideal
+* value is reached, > 0 = on until that time. A request with a time is dropped
+* when the time has passed. An ARB_MANUAL request for a device in auto mode is
+* dropped as well when another source changes its request for the device.
+*/
+void arb_request(int8_t source, int8_t device, int32_t end_time);
+void arb_release(int8_t source, int8_t device);
+bool arb_hasRequest(int8_t source, int8_t device);
+int32_t arb_getRequest(int8_t source, int8_t device);
+/*
+* Resolve the devices again at the next tick, for a change the arbiter does
+* not see itself, like a device that goes to manual mode.
+*/
+void arb_changed();
+/*
+* Drop the requests that have ended and switch each device to the state of
+* its request with the highest priority. A device in manual mode only follows
+* ARB_MANUAL. Only the devices whose state changes are written to.
+* It does nothing while no request has changed or ended.
+*/
+void arb_tick(time_t curtime);
+/*
+* Increased on every change of a request.
+*/
+uint16_t arb_getVersion();
+/*
+* The most seconds a request was dropped after its end_time, 1 means on time.
+* A larger value means the loop was stalled, a clock jump does not count.
+*/
+uint16_t arb_getMaxDelay();
+
+#endif /* ARBITER_H */
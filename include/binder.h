@@ -0,0 +1,86 @@
+#ifndef BINDER_H
+#define BINDER_H
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 24-3-2021
+* File : binder.h
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <stdint.h>
+#include <stddef.h>
+
+/*****************
+    Defines
+******************/
+#define BND_ERROR_SIZE  64
+
+// Field types
+#define BND_INT8         1  // number into an int8_t
+#define BND_INT16        2  // number into an int16_t
+#define BND_YESNO        3  // "yes" or "no" into a bool
+#define BND_TIME         4  // "HH:MM" into an int16_t, minutes since 00:00
+#define BND_DEVICE       5  // device name or "no device" into an int8_t device index
+#define BND_HOUR         6  // number of hours into the hours of an int16_t of minutes
+#define BND_MINUTE       7  // number of minutes into the minutes of an int16_t of minutes
+#define BND_ARRAY        8  // array of objects into an array of structs
+#define BND_ENUM         9  // one of the names into an int8_t, its index in the names
+#define BND_EXPR        10  // expression text into a length byte and its bytecode, see expression.h
+#define BND_FLAGS       11  // comma separated names into an int8_t, bit n set for names[n]
+
+// Field descriptors of member m of struct s
+#define BND_FIELD(s, name, m, type, min, max) \
+	{ name, type, offsetof(s, m), min, max, NULL, 0, 0, NULL }
+#define BND_ARRAY_OF(s, name, m, schema) \
+	{ name, BND_ARRAY, offsetof(s, m), 0, 0, &schema, \
+	  sizeof(((s *)0)->m) / sizeof(((s *)0)->m[0]), sizeof(((s *)0)->m[0]), NULL }
+#define BND_ENUM_OF(s, name, m, names) \
+	{ name, BND_ENUM, offsetof(s, m), 0, sizeof(names) / sizeof(names[0]) - 1, NULL, 0, 0, names }
+#define BND_FLAGS_OF(s, name, m, names) \
+	{ name, BND_FLAGS, offsetof(s, m), 1, (1 << sizeof(names) / sizeof(names[0])) - 1, NULL, 0, 0, names }
+#define BND_SCHEMA(fields) { fields, sizeof(fields) / sizeof(fields[0]) }
+
+/*****************
+    Structs
+******************/
+typedef struct Schema Schema;
+
+typedef struct {
+	const char *name;       // key in the JSON object
+	uint8_t type;
+	uint8_t offset;         // of the member in the struct
+	int16_t min;            // range of the value
+	int16_t max;
+	const Schema *schema;   // BND_ARRAY: the fields of an element
+	uint8_t count;          // BND_ARRAY: max nr of elements
+	uint8_t size;           // BND_ARRAY: size of an element
+	const char *const *names; // BND_ENUM, BND_FLAGS: the names of the values
+} Field;
+
+struct Schema {
+	const Field *fields;
+	uint8_t nr_of_fields;
+};
+
+/*************************
+    Function templates
+*************************/
+/*
+* Parse the JSON object and write the values of the fields of the schema into target.
+* Keys that are not in the schema are ignored, members without a key keep their value.
+* An array replaces all its elements, the ones after the last one that is sent are
+* cleared: 0, and "no device" for a device.
+*
+* param(out) error  the first error, e.g. "rules[1].value: out of range"
+* Returns false if there is an error, target may then be partly written.
+*/
+bool bnd_fromJson(const Schema *schema, const char *json, void *target, char *error);
+
+#endif /* BINDER_H */
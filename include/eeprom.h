@@ -16,11 +16,26 @@
 ******************/
 #include <stdint.h>
 #include "rules.h"
+#include "terrarium.h"
 #include "timers.h"
 
 /*****************
     Defines
 ******************/
+#define EPR_SIZE              256
+#define EPR_TIMER_SIZE         11  // sizeof(Timer)
+#define EPR_SPRAYER_RULE_SIZE  13  // sizeof(SprayerRule)
+#define EPR_COUNTERS_SIZE       8  // EEPROM write counter and hours on counter
+
+// The layout: 5 bytes with the numbers and addresses, the timers, the rulesets,
+// the sprayer rule and the counters. The rulesets get what the timers leave.
+constexpr uint8_t EPR_ADDRESS_TIMERS = 5;
+constexpr uint8_t EPR_ADDRESS_RULESETS = EPR_ADDRESS_TIMERS + MAX_NR_OF_TIMERS * EPR_TIMER_SIZE;
+constexpr uint8_t EPR_ADDRESS_COUNTERS = EPR_SIZE - EPR_COUNTERS_SIZE;
+constexpr uint8_t EPR_ADDRESS_SPRAYER_RULE = EPR_ADDRESS_COUNTERS - EPR_SPRAYER_RULE_SIZE;
+constexpr uint8_t EPR_RULESETS_SIZE = EPR_ADDRESS_SPRAYER_RULE - EPR_ADDRESS_RULESETS;
+static_assert(EPR_ADDRESS_TIMERS + MAX_NR_OF_TIMERS * EPR_TIMER_SIZE < EPR_ADDRESS_SPRAYER_RULE,
+	"MAX_NR_OF_TIMERS leaves no EEPROM for the rulesets");
 
 /*****************
     Structs
@@ -36,8 +51,9 @@ void epr_setNrOfTimersStored(int8_t nr);
 void epr_setNrOfRulesetsStored(int8_t nr);
 void epr_saveTimerToEEPROM(int8_t i, Timer *t);
 void epr_getTimerFromEEPROM(int8_t i, Timer *t);
-void epr_saveRulesetToEEPROM(int8_t i, RuleSet *rs);
-void epr_getRulesetFromEEPROM(int8_t i, RuleSet *rs);
+// All rulesets as one block of EPR_RULESETS_SIZE bytes
+void epr_saveRulesetsToEEPROM(const uint8_t *rulesets);
+void epr_getRulesetsFromEEPROM(uint8_t *rulesets);
 void epr_saveSprayerRuleToEEPROM(SprayerRule *sr);
 void epr_getSprayerRuleFromEEPROM(SprayerRule *sr);
 void epr_clearHoursOn();
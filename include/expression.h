@@ -0,0 +1,77 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 28-3-2021
+* File : expression.h
+* Expressions like "terrarium_temp > 28 && room_hum < 60", compiled into
+* bytecode for a small stack machine.
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <stdint.h>
+
+/*****************
+    Defines
+******************/
+#define XPR_MAX_CODE     24  // bytes of bytecode, so max 24 instructions per run
+#define XPR_STACK         8  // max depth of the stack
+#define XPR_MAX_TEXT    100  // max length of the text of an expression
+
+// Variables
+#define XPR_TERRARIUM_TEMP 0
+#define XPR_ROOM_TEMP      1
+#define XPR_ROOM_HUM       2
+#define XPR_MINUTE_OF_DAY  3
+#define XPR_NR_OF_VARS     4
+
+// Instructions, each is 1 byte, a constant is followed by its value
+#define XPR_VAR      0x00  // + variable: push the variable
+#define XPR_CONST8   0x08  // push the next byte
+#define XPR_CONST16  0x09  // push the next 2 bytes, low byte first
+#define XPR_LT       0x10  // pop b, pop a, push a < b
+#define XPR_LE       0x11
+#define XPR_GT       0x12
+#define XPR_GE       0x13
+#define XPR_EQ       0x14
+#define XPR_NE       0x15
+#define XPR_AND      0x16
+#define XPR_OR       0x17
+#define XPR_NOT      0x18  // pop a, push !a
+#define XPR_IN       0x19  // pop hi, pop lo, pop a, push lo <= a <= hi
+
+/*****************
+    Structs
+******************/
+
+/*************************
+    Function templates
+*************************/
+/*
+* Compile the text of len characters into code, code[0] gets the length of the bytecode
+* that follows it (max XPR_MAX_CODE), 0 if the text is empty.
+* Returns the reason it is rejected or NULL.
+*/
+const char *xpr_compile(const char *text, uint8_t len, uint8_t *code);
+/*
+* true if the bytecode leaves exactly one value and stays within the stack.
+*/
+bool xpr_isValid(const uint8_t *code, uint8_t len);
+/*
+* Run valid bytecode with the values of the variables.
+*/
+int16_t xpr_run(const uint8_t *code, uint8_t len, const int16_t *vars);
+/*
+* Write the valid bytecode as text again, text has room for XPR_MAX_TEXT characters.
+* Returns the length of the whole text, more than XPR_MAX_TEXT when it is cut off.
+*/
+uint16_t xpr_toText(const uint8_t *code, uint8_t len, char *text);
+
+#endif /* EXPRESSION_H */
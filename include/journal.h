@@ -0,0 +1,72 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 21-3-2021
+* File : journal.h
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <stdint.h>
+#include "jsonwriter.h"
+
+/*****************
+    Defines
+******************/
+#define JRN_SIZE           32   // nr of changes kept, 6 bytes each
+
+// Kinds of change
+#define JRN_DEVICE          1   // subject = device, value = end_time
+#define JRN_MANUAL          2   // subject = device, value = 1 manual, 0 auto
+#define JRN_TIMERS          3   // subject = device, value = timers version
+#define JRN_RULESET         4   // subject = ruleset index, value = rules version
+#define JRN_SPRAYERRULE     5   // subject = -1, value = rules version
+#define JRN_SENSOR          6   // subject = JRN_ROOM_TEMP.., value = new value
+#define JRN_THRESHOLD       7   // subject = ruleset * RLS_MAX_RULES + rule, value = 1 crossed, 0 back
+#define JRN_SPRAYER_RUN     8   // subject = -1, value = 1 sprayer rule started, 0 ended
+
+// Subjects of JRN_SENSOR
+#define JRN_ROOM_TEMP       0
+#define JRN_ROOM_HUM        1
+#define JRN_TERRARIUM_TEMP  2
+
+/*****************
+    Structs
+******************/
+typedef struct {
+	uint8_t kind;
+	int8_t subject;
+	int32_t value;
+} Change;
+
+/*************************
+    Function templates
+*************************/
+/*
+* Add a change to the journal, the oldest change is overwritten when it is full.
+*/
+void jrn_add(uint8_t kind, int8_t subject, int32_t value);
+/*
+* Sequence number of the last change, 0 = no changes yet.
+*/
+uint32_t jrn_getSeq();
+uint16_t jrn_getVersion();
+/*
+* Get the change with sequence number seq.
+* Returns false if it is not in the journal (anymore).
+*/
+bool jrn_get(uint32_t seq, Change *change);
+void jrn_getChangeAsJson(uint32_t seq, Change *change, JsonWriter *jw);
+/*
+* The changes after sequence number since, or "resync":true if some of them are lost.
+*/
+void jrn_getChangesAsJson(uint32_t since, JsonWriter *jw);
+
+#endif /* JOURNAL_H */
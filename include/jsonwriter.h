@@ -0,0 +1,85 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 20-3-2021
+* File : jsonwriter.h
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <stdint.h>
+#include <Arduino.h>
+
+/*****************
+    Defines
+******************/
+#define JW_BUFFER_SIZE  64  // bytes collected before they are sent as one chunk
+#define JW_MAX_DEPTH     8  // max nesting of objects and arrays
+#define JW_CBOR_TYPE    "application/cbor"
+#define JW_CBOR_MATCHED (sizeof(JW_CBOR_TYPE) - 1)
+
+/*****************
+    Structs
+******************/
+typedef struct {
+	Print *out;             // where the JSON text goes to (the WiFiClient)
+	bool chunked;           // true: HTTP/1.1 chunked transfer encoding
+	bool cbor;              // true: write CBOR (RFC 7049) instead of JSON text
+	char buf[JW_BUFFER_SIZE];
+	uint8_t len;
+	uint8_t depth;
+	uint8_t first;          // bit n set: nothing written yet on nesting level n
+	bool afterKey;          // a key is written, the value is next
+	uint32_t total;         // nr of JSON bytes written
+} JsonWriter;
+
+/*************************
+    Function templates
+*************************/
+/*
+* Start a new JSON text that is written to out.
+*
+* param(in) out      the stream to write to
+* param(in) chunked  wrap the text in HTTP chunks
+* param(in) cbor     write the same values as CBOR
+*/
+void jw_init(JsonWriter *jw, Print *out, bool chunked, bool cbor);
+/*
+* Send what is still buffered and, when chunked, the last (empty) chunk.
+*/
+void jw_end(JsonWriter *jw);
+void jw_flush(JsonWriter *jw);
+
+void jw_beginObject(JsonWriter *jw);
+void jw_endObject(JsonWriter *jw);
+void jw_beginArray(JsonWriter *jw);
+void jw_endArray(JsonWriter *jw);
+void jw_key(JsonWriter *jw, const char *key);
+// Values, the variants with a key are for members of an object
+void jw_string(JsonWriter *jw, const char *value);
+void jw_string(JsonWriter *jw, const char *key, const char *value);
+void jw_stringf(JsonWriter *jw, const char *key, const char *format, ...);
+void jw_long(JsonWriter *jw, int32_t value);
+void jw_long(JsonWriter *jw, const char *key, int32_t value);
+void jw_bool(JsonWriter *jw, bool value);
+void jw_bool(JsonWriter *jw, const char *key, bool value);
+/*
+* Write one CBOR item as JSON text, *cbor is moved past the item.
+* Returns false if it is malformed or uses a type JSON has no counterpart for.
+*/
+bool jw_fromCbor(JsonWriter *jw, const uint8_t **cbor, const uint8_t *end);
+/*
+* Search the media type application/cbor in a header value one character at a
+* time, so a long value needs no buffer. Start with matched 0 and pass what it
+* returns with the next character, JW_CBOR_MATCHED means it was found.
+*/
+uint8_t jw_matchCborType(uint8_t matched, char c);
+
+#endif /* JSONWRITER_H */
@@ -14,6 +14,9 @@
 /*****************
     Includes
 ******************/
+#include <WiFiNINA.h>
+#include "jsonwriter.h"
+#include "utility/jsmn.h"
 
 /*****************
     Defines
@@ -23,9 +26,93 @@
 #define POST    3
 #define DELETE  4
 
+#define REST_MAX_CONNECTIONS  3     // number of clients that are served at the same time
+#define REST_BYTES_PER_PASS   64    // max bytes read from a client in one loop() pass
+#define REST_REQ_LINE_SIZE    80    // room for a query, e.g. /snapshot?fields=...
+#define REST_HEADER_SIZE      40
+#define REST_BODY_SIZE      1300
+#define REST_MAX_CONTENT  65535UL   // max Content-Length, a streamed body may be larger than REST_BODY_SIZE
+#define REST_BODY_TOKENS      24    // arena tokens one element of a streamed body may use
+#define REST_READ_TIMEOUT   5000    // ms without any progress before a client is dropped
+#define REST_LINGER_TIME    2000    // ms the client gets to close the connection itself
+#define REST_IDLE_TIMEOUT   5000    // ms a keep-alive connection may wait for its next request
+#define REST_MAX_REQUESTS     16    // requests served on one connection before it is closed
+#define REST_MAX_SUBSCRIBERS   2    // connections that may stream /events at the same time
+#define REST_EVENTS_PER_PASS   2    // max events sent to a subscriber in one loop() pass
+#define REST_EVENT_PING    15000    // ms of silence after which a subscriber gets a comment line
+#define REST_ROUTE_SLOTS      32    // size of the perfect hash table of the routes
+#define REST_ROUTE_HASH       41    // change this when two routes end up in the same slot
+
+// Route flags
+#define ROUTE_JSON          0x01    // handler writes a JSON body
+#define ROUTE_BODY          0x02    // handler reads the request body from jsonString
+#define ROUTE_EVENTS        0x04    // the connection becomes a server-sent event stream
+#define ROUTE_STREAM        0x08    // the body is an array, handler is called per element while it arrives
+
+// Connection states
+#define CONN_FREE           0
+#define CONN_REQUEST_LINE   1
+#define CONN_HEADERS        2
+#define CONN_BODY           3
+#define CONN_DISPATCH       4
+#define CONN_LINGER         5
+#define CONN_EVENTS         6
+
+// States of a streamed body
+#define BODY_START          0       // before the '['
+#define BODY_ELEMENTS       1
+#define BODY_DONE           2       // after the ']'
+
 /*****************
     Structs
 ******************/
+// Typed values of the {...} placeholders in a route pattern
+typedef struct {
+	int8_t setnr;                   // {setnr}: ruleset index, 0-based
+	int8_t device;                  // {device}: device index
+	int32_t period;                 // {period}: seconds
+	int32_t value;                  // {value}, {room}: first number
+	int32_t value2;                 // {terrarium}: second number
+	const char *text;               // {datetime}: points into the request line
+	const char *query;              // text after the '?', NULL if none
+	const char *error;              // set by a handler that rejects (part of) the body
+} RouteParams;
+
+typedef void (*RouteHandler)(RouteParams *params, JsonWriter *jw);
+typedef uint16_t (*RouteVersion)();
+
+typedef struct {
+	int8_t method;
+	const char *pattern;            // e.g. "/ruleset/{setnr}"
+	uint8_t flags;
+	RouteHandler handler;
+	RouteVersion version;           // version of the data behind a GET, sent as ETag (NULL = none)
+	uint16_t key;                   // hash of method and first path segment
+} Route;
+
+typedef struct {
+	WiFiClient client;
+	int8_t state;
+	char req[REST_REQ_LINE_SIZE];   // request line: [method] [url]
+	bool http11;                    // false: HTTP/1.0 client, no chunked responses
+	bool keepalive;                 // true: connection stays open after the response
+	bool cbor;                      // true: client accepts application/cbor responses
+	bool cbor_body;                 // true: request body is application/cbor
+	const char *body_error;         // why the request body is rejected, NULL = accepted
+	uint8_t nr_of_requests;         // requests served on this connection
+	uint8_t reqlen;
+	int8_t route;                   // index in the route table
+	RouteParams params;
+	char header[REST_HEADER_SIZE];  // header line that is being read
+	uint8_t headerlen;
+	uint8_t cbormatch;              // chars of application/cbor matched in the header line, see jw_matchCborType
+	uint16_t content_length;
+	uint16_t bodylen;               // nr of body bytes received
+	int32_t if_none_match;          // version in the If-None-Match header, -1 = none, -2 = "*"
+	int32_t etag;                   // route and version sent as ETag, -1 = none
+	uint32_t event_seq;             // journal entry last sent to an event stream
+	uint32_t timestamp;             // millis() of the last progress
+} Connection;
 
 /*************************
     Function templates
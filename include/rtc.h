@@ -37,7 +37,7 @@ int8_t rtc_hour(time_t tm);
 int8_t rtc_minute(time_t tm);
 int8_t rtc_second(time_t tm);
 void rtc_setTime(time_t tm);
-void rtc_setTime(char *timestr); // Only format is "2020-10-06T15:30"
+void rtc_setTime(const char *timestr); // Only format is "2020-10-06T15:30"
 
 #endif /* RTC_H */
 
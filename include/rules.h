@@ -16,34 +16,55 @@
 ******************/
 #include <TimeLib.h>
 #include <stdint.h>
+#include "expression.h"
+#include "jsonwriter.h"
 /*****************
     Defines
 ******************/
+// Limits of one ruleset in JSON, the stored rulesets only hold what is used
+#define RLS_MAX_RULES    3
+#define RLS_MAX_ACTIONS  4
+// Kinds of rules, a negative value heats (below -value), a positive value cools (above value)
+#define RLS_THRESHOLD    0  // on beyond value, off from temp_ideal
+#define RLS_HYSTERESIS   1  // on beyond value, off band degrees back
+#define RLS_RATE         2  // on while the temperature changes value degrees in minutes
+#define RLS_PID          3  // on for a part of every PID window, from a PID loop around value
+#define RLS_EXPR         4  // on while the expression is true, the value is not used
+#define RLS_NR_OF_KINDS  5
+#define RLS_RATE_MINUTES 10   // max minutes of a rate rule
+#define RLS_PID_WINDOW   300  // seconds
 
 /*****************
     Structs
 ******************/
 
-typedef struct {
+typedef struct __attribute__((packed)) { // 3 bytes, on the ATmega and the host
     int8_t device;          // -1 = no device
     int16_t on_period;      // 0 = off, -1 = on, endless, -2 = on, until ideal value is reached, > 0 = on for 1-3600 seconds
 } Action;
 
-typedef struct { // size in bytes: 1 + 4 * 3 = 13
-    int8_t value;           // positive = if above value, negative = if below value
-    Action actions[4];
+typedef struct {
+    int8_t value;           // positive = if above value, negative = if below value, 0 = no rule
+    int8_t kind;            // RLS_THRESHOLD, ...
+    int8_t band;            // RLS_HYSTERESIS: degrees
+    int8_t minutes;         // RLS_RATE: the value is the change in this nr of minutes
+    int8_t kp;              // RLS_PID: % on-time per degree from value
+    int8_t ki;              // RLS_PID: % on-time per degree per window
+    int8_t kd;              // RLS_PID: % on-time per degree change since the last window
+    uint8_t expr[1 + XPR_MAX_CODE]; // RLS_EXPR: length of the bytecode, the bytecode
+    Action actions[RLS_MAX_ACTIONS];
 } Rule;
 
-typedef struct { // size in bytes: 7 + 2 * 13 = 33
+typedef struct { // a ruleset as it is read from and written to JSON
 	int8_t terrarium_nr;
 	bool active;
 	int16_t from; // 1-1440 minutes
 	int16_t to;   // 1-1440 minutes
 	int8_t temp_ideal;
-	Rule rules[2];
+	Rule rules[RLS_MAX_RULES];
 } RuleSet;
 
-typedef struct {
+typedef struct __attribute__((packed)) { // 13 bytes, on the ATmega and the host
 	int8_t  delay;          // in minutes,max 255
     Action actions[4];
 } SprayerRule;
@@ -55,16 +76,25 @@ void rls_initEEPROM();
 void rls_init();
 
 void rls_setSprayerRuleFromJson(char *json);
-void rls_getSprayerRuleAsJson(char *json);
+void rls_getSprayerRuleAsJson(JsonWriter *jw);
 void rls_startSprayerRule(time_t curtime);
 bool rls_isSprayerRuleActive();
+/*
+* Every tick: start the sprayer rule when the sprayer goes off, and request its
+* actions when its delay has passed.
+*/
 void rls_checkSprayerRule(time_t curtime);
 
 void rls_setRuleSetFromJson(int8_t setnr, char *json);
-void rls_getRuleSetAsJson(int8_t setnr, char *json);
+void rls_getRuleSetAsJson(int8_t setnr, JsonWriter *jw);
+/*
+* Evaluate the temperature rules, but only when the temperature, the time of
+* day, a ruleset or a device request has changed in a way that matters to them.
+*/
 void rls_checkTempRules(time_t curtime);
 
 void rls_switchRulesetsOff(void);
 void rls_switchRulesetsOn(void);
+uint16_t rls_getVersion();
 
 #endif /* RULES_H */
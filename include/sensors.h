@@ -14,6 +14,7 @@
 /*****************
     Includes
 ******************/
+#include "jsonwriter.h"
 
 /*****************
     Defines
@@ -28,12 +29,14 @@
 *************************/
 void sensors_init();
 void sensors_read();
-void sensors_tojson(char *json);
+void sensors_tojson(JsonWriter *jw);
 // Getters
 int8_t sensors_getRoomTemp();
+int8_t sensors_getRoomHum();
 int8_t sensors_getTerrariumTemp();
+uint16_t sensors_getVersion();
 // Setters
-void sensors_setTestValues(char *testurl);
+void sensors_setTestValues(int8_t room, int8_t terrarium);
 void sensors_setTestOff();
 
 #endif /* SENSORS_H */
@@ -14,17 +14,15 @@
     Includes
 ******************/
 #include <stdint.h>
-#include <WiFiNINA.h>
 #include <TimeLib.h>
+#include "jsonwriter.h"
 /*****************
     Defines
 ******************/
-// EEPROM has 256 bytes.
-// Each timer   ( 9 bytes)
-// Each ruleset (33 bytes)
-// Sprayer rule is 14 bytes
-#define NR_OF_RULESETS   2  // 2 x 33 bytes = 66 bytes
-#define MAX_NR_OF_TIMERS 18  // 250 - 66(rules) - 14(sprayer) = 170 / 9 = max 18 timers
+// EEPROM has 256 bytes, see eeprom.h for the layout.
+// Each timer is 11 bytes, the rulesets share the bytes the timers leave.
+#define NR_OF_RULESETS   6  // max, an unused ruleset takes 1 byte
+#define MAX_NR_OF_TIMERS 14  // 14 x 11 bytes, leaves 76 bytes for the rulesets
 // All pins on Arduino Uno Wifi Rev2
 #define pin_serial_tx    0
 #define pin_serial_rx    1
@@ -44,25 +42,31 @@
 #define pin_sensor_in   17
 #define lcd_sda         18
 #define lcd_scl         19
-// Devices
+// Device IDs, the index in devices[]
+#define UNKNOWN_DEVICE -2
+#define NO_DEVICE      -1
 #define LIGHT1          0
 #define LIGHT2          1
 #define UVLIGHT         2
-#define SPRAYER         3
-#define FAN_IN          4
-#define FAN_OUT         5
+#define FAN_IN          3
+#define FAN_OUT         4
+#define SPRAYER         5
 #define NR_OF_DEVICES   6
+#define MIST    NO_DEVICE  // this terrarium has no mist device
+// Device names are found with a perfect hash
+#define GEN_DEVICE_SLOTS 16
+#define GEN_DEVICE_HASH   3  // change this when two names end up in the same slot
 
 /*****************
     Structs
 ******************/
 
 typedef struct {
-    char *name;
+    const char *name;
     int8_t pin_nr;
     int8_t nr_of_timers;
     int32_t end_time; // on, endtime in seconds since 2000-01-01 or -1 = until ideal value is reached, -2 = endless, off = 0
-    int8_t temprule; // true/1: device is on because of a temperature rule, false/0: on because of a timer setting
+    int8_t source; // ARB_TIMER, ARB_RULE, ...: the request the state is from, ARB_NONE when off
     int8_t lcc; // true: lifecycle of this device is counted
     int32_t on_time; // counting the total number of seconds the device was on
     bool manual; // true = device is manually controlled.
@@ -75,21 +79,27 @@ void gen_initEEPROM();
 void gen_init();
 void gen_setup();
 Device *gen_getDevices();
-int8_t gen_getDeviceIndex(char *device);
+/*
+* The ID of the device with the given name of len characters, NO_DEVICE for
+* "no device" and UNKNOWN_DEVICE for any other name.
+*/
+int8_t gen_getDeviceId(const char *name, uint8_t len);
 bool gen_isTraceOn();
 void gen_setTraceOn(bool on);
-void gen_getProperties(char *json);
-void gen_getDeviceStates(char *json);
+void gen_getProperties(JsonWriter *jw);
+void gen_getDeviceStates(JsonWriter *jw);
 bool gen_isDeviceOn(int8_t device);
 int32_t gen_getEndTime(int8_t device);
-int8_t gen_isSetByRule(int8_t device);
+int8_t gen_getSource(int8_t device);
 void gen_setDeviceToManual(int8_t device, bool yes);
 bool gen_isDeviceOnManual(int8_t device);
-void gen_setDeviceState(char *devurl);
-void gen_setDeviceState(int8_t device, int32_t end_time, int8_t temprule);
-void gen_checkDeviceStates(time_t curtime);
+/*
+* Switch the device, only the arbiter calls this (see arbiter.h).
+*/
+void gen_setDeviceState(int8_t device, int32_t end_time, int8_t source);
 void gen_showState(char *txt, int8_t device);
 void gen_increase_time_on();
-void gen_setCounter(char *devurl);
+void gen_setCounter(int8_t device, int32_t value);
+uint16_t gen_getVersion();
 
 #endif /* TERRARIUM_H */
\ No newline at end of file
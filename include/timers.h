@@ -16,21 +16,26 @@
 ******************/
 #include <stdint.h>
 #include "rtc.h"
+#include "jsonwriter.h"
 
 /*****************
     Defines
 ******************/
+#define TMR_EVERY_DAY 0x7F  // all bits of Timer.weekdays
 
 /*****************
     Structs
 ******************/
-typedef struct {
+// A timer runs on the days that are in weekdays and are repeat_in_days apart
+typedef struct __attribute__((packed)) { // 11 bytes, on the ATmega and the host
     int8_t device;
     int8_t index;
     int16_t minutes_on;    // max 1440 = hours * 60 + minutes
     int16_t minutes_off;   // max 1440 = hours * 60 + minutes
     int16_t on_period;     // max 3600 sec = 1 hour
-    int8_t repeat_in_days; // 1 - 7, default 1
+    int8_t repeat_in_days; // 1 - 7, default 1, 0 = not used
+    uint8_t weekdays;      // bit n set: it runs on weekday n, sunday = 0, default TMR_EVERY_DAY
+    uint8_t phase;         // it runs on the days whose number % repeat_in_days is phase
 } Timer;
 
 /*************************
@@ -38,10 +43,14 @@ typedef struct {
 *************************/
 void tmr_initEEPROM();
 void tmr_init();
-void tmr_setTimersFromJson(char *json);
-void tmr_getTimerAsJson(int8_t device, int8_t ix, char *json);
-void tmr_getTimerAsJson(Timer *t, char *json);
-void tmr_getTimersAsJson(char *device, char *json);
+/*
+* Set one timer, on failure error gets the reason (BND_ERROR_SIZE)
+*/
+bool tmr_setTimerFromJson(char *json, char *error);
+void tmr_getTimerAsJson(int8_t device, int8_t ix, JsonWriter *jw);
+void tmr_getTimerAsJson(Timer *t, JsonWriter *jw);
+void tmr_getTimersAsJson(int8_t device, JsonWriter *jw);
+uint16_t tmr_getVersion();
 void tmr_check(time_t curtime);
 void tmr_dump(char *prefix);
 
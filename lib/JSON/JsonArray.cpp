@@ -7,7 +7,7 @@
 #include "JsonHashTable.h"
 
 JsonArray::JsonArray(char* json, jsmntok_t* tokens)
-: JsonObjectBase(json, tokens)
+: JsonObjectBase(json, tokens), lastIndex(-1)
 {
 	if (tokens == 0 || tokens[0].type != JSMN_ARRAY)
 		makeInvalid();
@@ -23,16 +23,24 @@ jsmntok_t* JsonArray::getToken(int index)
 	if (json == 0 || tokens == 0 || index < 0 || index >= tokens[0].size)
 		return 0;
 
-	// skip first token, it's the whole object
+	// skip first token, it's the whole object, or continue from the last one found
+	int i = 0;
 	jsmntok_t* currentToken = tokens + 1;
+	if (lastIndex != -1 && lastIndex <= index)
+	{
+		i = lastIndex;
+		currentToken = lastToken;
+	}
 
 	// skip all tokens before the specified index
-	for (int i = 0; i < index; i++)
+	for (; i < index; i++)
 	{
 		// move forward: current + nested tokens
-		currentToken += 1 + getNestedTokenCount(currentToken);
+		currentToken += currentToken->skip;
 	}
 
+	lastIndex = index;
+	lastToken = currentToken;
 	return currentToken;
 }
 
@@ -46,11 +54,6 @@ bool JsonArray::getBool(int index)
 	return getBoolFromToken(getToken(index));
 }
 
-double JsonArray::getDouble(int index)
-{
-	return getDoubleFromToken(getToken(index));
-}
-
 JsonHashTable JsonArray::getHashTable(int index)
 {
 	return JsonHashTable(json, getToken(index));
@@ -19,7 +19,7 @@ class JsonArray : public JsonObjectBase
 
 public:
 
-	JsonArray()	{}
+	JsonArray()	: lastIndex(-1) {}
 
 	int getLength()
 	{
@@ -28,7 +28,6 @@ public:
 
 	JsonArray getArray(int index);
 	bool getBool(int index);
-	double getDouble(int index);
 	JsonHashTable getHashTable(int index);
 	long getLong(int index);
 	char* getString(int index);
@@ -37,6 +36,10 @@ private:
 
 	JsonArray(char* json, jsmntok_t* tokens);
 	jsmntok_t* getToken(int index);
+
+	// the last token found, so a loop over the elements is linear
+	int lastIndex;
+	jsmntok_t* lastToken;
 };
 
 #endif
\ No newline at end of file
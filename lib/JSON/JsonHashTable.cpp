@@ -6,8 +6,6 @@
 #include "JsonArray.h"
 #include "JsonHashTable.h"
 
-#include <string.h> // for strcmp()
-
 JsonHashTable::JsonHashTable(char* json, jsmntok_t* tokens)
 : JsonObjectBase(json, tokens)
 {
@@ -30,18 +28,15 @@ jsmntok_t* JsonHashTable::getToken(const char* desiredKey)
 	// scan each keys
 	for (int i = 0; i < tokens[0].size / 2 ; i++)
 	{
-		// get key token string
-		char* key = getStringFromToken(currentToken);
-
-		// compare with desired name
-		if (strcmp(desiredKey, key) == 0)
+		// compare the key token with desired name
+		if (tokenEquals(currentToken, desiredKey))
 		{
 			// return the value token that follows the key token
 			return currentToken + 1;
 		}
 
-		// move forward: key + value + nested tokens
-		currentToken += 2 + getNestedTokenCount(currentToken + 1);
+		// move forward: key + value, nested tokens are skipped at once
+		currentToken += 1 + currentToken[1].skip;
 	}
 
 	// nothing found, return NULL
@@ -63,11 +58,6 @@ bool JsonHashTable::getBool(const char* key)
 	return getBoolFromToken(getToken(key));
 }
 
-double JsonHashTable::getDouble(const char* key)
-{
-	return getDoubleFromToken(getToken(key));
-}
-
 JsonHashTable JsonHashTable::getHashTable(const char* key)
 {
 	return JsonHashTable(json, getToken(key));
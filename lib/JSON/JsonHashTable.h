@@ -25,7 +25,6 @@ public:
 
 	JsonArray getArray(const char* key);
 	bool getBool(const char* key);
-	double getDouble(const char* key);
 	JsonHashTable getHashTable(const char* key);
 	long getLong(const char* key);
 	char* getString(const char* key);
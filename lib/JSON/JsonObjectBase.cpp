@@ -6,27 +6,17 @@
 
 #include "JsonObjectBase.h"
 
-#include <stdlib.h> // for strtol, strtod
+#include <string.h> // for strncmp()
 
 int JsonObjectBase::getNestedTokenCount(jsmntok_t* token)
 {
-	int end = token->end;
-	int count = 0;	
-
-	token++;
-
-	while (token->start < end)
-	{
-		token++;
-		count++;
-	}
-
-	return count;
+	// the parser has counted them already
+	return token->skip - 1;
 }
 
 bool JsonObjectBase::getBoolFromToken(jsmntok_t* token)
 {
-	if (token->type != JSMN_PRIMITIVE) return 0;
+	if (token == 0 || token->type != JSMN_PRIMITIVE) return 0;
 
 	// "true"
 	if (json[token->start] == 't') return true;
@@ -38,21 +28,25 @@ bool JsonObjectBase::getBoolFromToken(jsmntok_t* token)
 	if (json[token->start] == 'n') return false;
 	
 	// number
-	return strtol(json + token->start, 0, 0) != 0;
+	return getLongFromToken(token) != 0;
 }
 
-double JsonObjectBase::getDoubleFromToken(jsmntok_t* token)
+long JsonObjectBase::getLongFromToken(jsmntok_t* token)
 {
-	if (token == 0 || token->type != JSMN_PRIMITIVE) return 0;
+	int32_t value = 0;
+
+	// 0 if it is not a number or does not fit
+	if (token != 0) jsmn_int32(json, token, &value);
 
-	return strtod(json + token->start, 0);
+	return value;
 }
 
-long JsonObjectBase::getLongFromToken(jsmntok_t* token)
+bool JsonObjectBase::tokenEquals(jsmntok_t* token, const char* s)
 {
-	if (token == 0 || token->type != JSMN_PRIMITIVE) return 0;
+	int len = token->end - token->start;
 
-	return strtol(json + token->start, 0, 0);
+	// compare in place, the token is not terminated
+	return strncmp(json + token->start, s, len) == 0 && s[len] == 0;
 }
 
 char* JsonObjectBase::getStringFromToken(jsmntok_t* token)
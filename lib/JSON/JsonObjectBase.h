@@ -40,9 +40,9 @@ protected:
 	static int getNestedTokenCount(jsmntok_t* token);
 
 	bool getBoolFromToken(jsmntok_t* token);
-	double getDoubleFromToken(jsmntok_t* token);
 	long getLongFromToken(jsmntok_t* token);
 	char* getStringFromToken(jsmntok_t* token);
+	bool tokenEquals(jsmntok_t* token, const char* s);
 
 	char* json;
 	jsmntok_t* tokens;
@@ -6,16 +6,17 @@
 #ifndef __JSONPARSER_H
 #define __JSONPARSER_H
 
+#include <string.h>
 #include "JsonHashTable.h"
 #include "JsonArray.h"
 
 /*
 * The JSON parser.
 *
-* You need to specifiy the number of token to be allocated for that parser.
-* Values from 16 to 32 are recommended.
-* The parser size will be MAX_TOKEN*8 bytes.
-* Don't forget that the memory size of standard Arduino board is only 2KB
+* You need to specifiy the max number of tokens for that parser, at most
+* JSMN_ARENA_SIZE. The tokens are not part of the parser: it borrows the
+* shared token arena in parse() and gives it back when it is destroyed,
+* so only one JsonParser can hold parse results at a time.
 *
 * CAUTION: JsonArray and JsonHashTable contain pointers to tokens of the
 * JsonParser, so they need the JsonParser to be in memory to work.
@@ -25,8 +26,18 @@
 template <int MAX_TOKENS>
 class JsonParser
 {
+	static_assert(MAX_TOKENS <= JSMN_ARENA_SIZE, "the token arena is too small");
+
 public:
 
+	JsonParser() : tokens(0) {}
+
+	~JsonParser()
+	{
+		if (tokens)
+			jsmn_return();
+	}
+
 	/*
 	* Parse the JSON string and return a array.
 	*
@@ -53,16 +64,21 @@ private:
 
 	jsmntok_t* parse(char* json)
 	{
+		if (tokens == 0)
+			tokens = jsmn_borrow();
+		if (tokens == 0)
+			return 0;
+
 		jsmn_parser parser;
 		jsmn_init(&parser);
 
-		if (JSMN_SUCCESS != jsmn_parse(&parser, json, tokens, MAX_TOKENS))
+		if (JSMN_SUCCESS != jsmn_parse(&parser, json, strlen(json), tokens, MAX_TOKENS))
 			return 0;
 
 		return tokens;
 	}
 
-	jsmntok_t tokens[MAX_TOKENS];
+	jsmntok_t* tokens;
 };
 
 #endif
@@ -47,7 +47,7 @@ void ParseAnObject()
 
 void ParseAnArray()
 {
-    char json[] = "[[1.2,3.4],[5.6,7.8]]";
+    char json[] = "[[12,34],[56,78]]";
 
     JsonParser<32> parser;
 
@@ -70,7 +70,7 @@ void ParseAnArray()
 
         for (int j = 0; j < innerArray.getLength(); j++)
         {
-            double value = innerArray.getDouble(j);
+            long value = innerArray.getLong(j);
 
             Serial.print("  ");
             Serial.print(j);
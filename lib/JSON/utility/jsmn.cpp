@@ -2,6 +2,9 @@
 
 #include "jsmn.h"
 
+static jsmntok_t jsmn_arena[JSMN_ARENA_SIZE];
+static bool jsmn_lent = false;
+
 /**
  * Allocates a fresh unused token from the token pull.
  */
@@ -12,8 +15,9 @@ static jsmntok_t *jsmn_alloc_token(jsmn_parser *parser,
 		return NULL;
 	}
 	tok = &tokens[parser->toknext++];
-	tok->start = tok->end = -1;
+	tok->start = tok->end = JSMN_NONE;
 	tok->size = 0;
+	tok->skip = 1;
 #ifdef JSMN_PARENT_LINKS
 	tok->parent = -1;
 #endif
@@ -35,13 +39,13 @@ static void jsmn_fill_token(jsmntok_t *token, jsmntype_t type,
  * Fills next available token with JSON primitive.
  */
 static jsmnerr_t jsmn_parse_primitive(jsmn_parser *parser, const char *js,
-		jsmntok_t *tokens, size_t num_tokens) {
+		unsigned int len, jsmntok_t *tokens, size_t num_tokens) {
 	jsmntok_t *token;
 	int start;
 
 	start = parser->pos;
 
-	for (; js[parser->pos] != '\0'; parser->pos++) {
+	for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
 		switch (js[parser->pos]) {
 #ifndef JSMN_STRICT
 			/* In strict mode primitive must be followed by "," or "}" or "]" */
@@ -56,6 +60,11 @@ static jsmnerr_t jsmn_parse_primitive(jsmn_parser *parser, const char *js,
 			return JSMN_ERROR_INVAL;
 		}
 	}
+	/* More characters of the primitive may still arrive */
+	if (parser->pos == len) {
+		parser->pos = start;
+		return JSMN_ERROR_PART;
+	}
 #ifdef JSMN_STRICT
 	/* In strict mode primitive must be followed by a comma/object/array */
 	parser->pos = start;
@@ -80,7 +89,7 @@ found:
  * Filsl next token with JSON string.
  */
 static jsmnerr_t jsmn_parse_string(jsmn_parser *parser, const char *js,
-		jsmntok_t *tokens, size_t num_tokens) {
+		unsigned int len, jsmntok_t *tokens, size_t num_tokens) {
 	jsmntok_t *token;
 
 	int start = parser->pos;
@@ -88,7 +97,7 @@ static jsmnerr_t jsmn_parse_string(jsmn_parser *parser, const char *js,
 	parser->pos++;
 
 	/* Skip starting quote */
-	for (; js[parser->pos] != '\0'; parser->pos++) {
+	for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
 		char c = js[parser->pos];
 
 		/* Quote: end of string */
@@ -108,6 +117,9 @@ static jsmnerr_t jsmn_parse_string(jsmn_parser *parser, const char *js,
 		/* Backslash: Quoted symbol expected */
 		if (c == '\\') {
 			parser->pos++;
+			if (parser->pos == len) {
+				break;
+			}
 			switch (js[parser->pos]) {
 				/* Allowed escaped symbols */
 				case '\"': case '/' : case '\\' : case 'b' :
@@ -131,13 +143,13 @@ static jsmnerr_t jsmn_parse_string(jsmn_parser *parser, const char *js,
 /**
  * Parse JSON string and fill tokens.
  */
-jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, jsmntok_t *tokens, 
-		unsigned int num_tokens) {
+jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, unsigned int len,
+		jsmntok_t *tokens, unsigned int num_tokens) {
 	jsmnerr_t r;
 	int i;
 	jsmntok_t *token;
 
-	for (; js[parser->pos] != '\0'; parser->pos++) {
+	for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
 		char c;
 		jsmntype_t type;
 
@@ -165,11 +177,12 @@ jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, jsmntok_t *tokens,
 				}
 				token = &tokens[parser->toknext - 1];
 				for (;;) {
-					if (token->start != -1 && token->end == -1) {
+					if (token->start != JSMN_NONE && token->end == JSMN_NONE) {
 						if (token->type != type) {
 							return JSMN_ERROR_INVAL;
 						}
 						token->end = parser->pos + 1;
+						token->skip = parser->toknext - (token - tokens);
 						parser->toksuper = token->parent;
 						break;
 					}
@@ -181,12 +194,13 @@ jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, jsmntok_t *tokens,
 #else
 				for (i = parser->toknext - 1; i >= 0; i--) {
 					token = &tokens[i];
-					if (token->start != -1 && token->end == -1) {
+					if (token->start != JSMN_NONE && token->end == JSMN_NONE) {
 						if (token->type != type) {
 							return JSMN_ERROR_INVAL;
 						}
 						parser->toksuper = -1;
 						token->end = parser->pos + 1;
+						token->skip = parser->toknext - i;
 						break;
 					}
 				}
@@ -194,18 +208,27 @@ jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, jsmntok_t *tokens,
 				if (i == -1) return JSMN_ERROR_INVAL;
 				for (; i >= 0; i--) {
 					token = &tokens[i];
-					if (token->start != -1 && token->end == -1) {
+					if (token->start != JSMN_NONE && token->end == JSMN_NONE) {
 						parser->toksuper = i;
 						break;
 					}
 				}
 #endif
+				/* The first value is complete, what follows is not ours */
+				if (parser->toksuper == -1) {
+					parser->pos++;
+					return JSMN_SUCCESS;
+				}
 				break;
 			case '\"':
-				r = jsmn_parse_string(parser, js, tokens, num_tokens);
+				r = jsmn_parse_string(parser, js, len, tokens, num_tokens);
 				if (r < 0) return r;
-				if (parser->toksuper != -1)
-					tokens[parser->toksuper].size++;
+				if (parser->toksuper == -1) {
+					/* A string on its own is the first value as well */
+					parser->pos++;
+					return JSMN_SUCCESS;
+				}
+				tokens[parser->toksuper].size++;
 				break;
 			case '\t' : case '\r' : case '\n' : case ':' : case ',': case ' ': 
 				break;
@@ -218,10 +241,13 @@ jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, jsmntok_t *tokens,
 			/* In non-strict mode every unquoted value is a primitive */
 			default:
 #endif
-				r = jsmn_parse_primitive(parser, js, tokens, num_tokens);
+				r = jsmn_parse_primitive(parser, js, len, tokens, num_tokens);
 				if (r < 0) return r;
-				if (parser->toksuper != -1)
-					tokens[parser->toksuper].size++;
+				if (parser->toksuper == -1) {
+					parser->pos++;
+					return JSMN_SUCCESS;
+				}
+				tokens[parser->toksuper].size++;
 				break;
 
 #ifdef JSMN_STRICT
@@ -233,9 +259,14 @@ jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, jsmntok_t *tokens,
 		}
 	}
 
+	/* Nothing but separators so far */
+	if (parser->toknext == 0) {
+		return JSMN_ERROR_PART;
+	}
+
 	for (i = parser->toknext - 1; i >= 0; i--) {
 		/* Unmatched opened object or array */
-		if (tokens[i].start != -1 && tokens[i].end == -1) {
+		if (tokens[i].start != JSMN_NONE && tokens[i].end == JSMN_NONE) {
 			return JSMN_ERROR_PART;
 		}
 	}
@@ -253,3 +284,104 @@ void jsmn_init(jsmn_parser *parser) {
 	parser->toksuper = -1;
 }
 
+/**
+ * Digits of a number primitive, at most limit. 16 bit arithmetic is much
+ * cheaper than 32 bit on AVR, so there is a version for each.
+ */
+static bool jsmn_digits16(const char *s, const char *end, uint16_t limit, uint16_t *value) {
+	uint16_t max10 = limit / 10;
+	uint8_t maxDigit = limit % 10;
+	uint16_t v = 0;
+	if (s == end) {
+		return false;
+	}
+	for (; s < end; s++) {
+		uint8_t d = *s - '0';
+		if (d > 9 || v > max10 || (v == max10 && d > maxDigit)) {
+			return false;
+		}
+		v = v * 10 + d;
+	}
+	*value = v;
+	return true;
+}
+
+static bool jsmn_digits32(const char *s, const char *end, uint32_t limit, uint32_t *value) {
+	uint32_t max10 = limit / 10;
+	uint8_t maxDigit = limit % 10;
+	uint32_t v = 0;
+	if (s == end) {
+		return false;
+	}
+	for (; s < end; s++) {
+		uint8_t d = *s - '0';
+		if (d > 9 || v > max10 || (v == max10 && d > maxDigit)) {
+			return false;
+		}
+		v = v * 10 + d;
+	}
+	*value = v;
+	return true;
+}
+
+bool jsmn_int8(const char *js, const jsmntok_t *tok, int8_t *value) {
+	int16_t v;
+	if (!jsmn_int16(js, tok, &v) || v < INT8_MIN || v > INT8_MAX) {
+		return false;
+	}
+	*value = v;
+	return true;
+}
+
+bool jsmn_int16(const char *js, const jsmntok_t *tok, int16_t *value) {
+	const char *s = js + tok->start;
+	const char *end = js + tok->end;
+	uint16_t v;
+	if (tok->type != JSMN_PRIMITIVE) {
+		return false;
+	}
+	bool neg = (*s == '-');
+	if (!jsmn_digits16(s + neg, end, neg ? 32768U : 32767U, &v)) {
+		return false;
+	}
+	*value = (neg ? -v : v);
+	return true;
+}
+
+bool jsmn_int32(const char *js, const jsmntok_t *tok, int32_t *value) {
+	const char *s = js + tok->start;
+	const char *end = js + tok->end;
+	uint32_t v;
+	if (tok->type != JSMN_PRIMITIVE) {
+		return false;
+	}
+	bool neg = (*s == '-');
+	if (!jsmn_digits32(s + neg, end, neg ? 0x80000000UL : 0x7FFFFFFFUL, &v)) {
+		return false;
+	}
+	*value = (neg ? -v : v);
+	return true;
+}
+
+bool jsmn_minutes(const char *js, const jsmntok_t *tok, int16_t *value) {
+	const char *s = js + tok->start;
+	uint16_t hours, minutes;
+	if (tok->type != JSMN_STRING || tok->end - tok->start != 5 || s[2] != ':'
+			|| !jsmn_digits16(s, s + 2, 99, &hours) || !jsmn_digits16(s + 3, s + 5, 59, &minutes)) {
+		return false;
+	}
+	*value = hours * 60 + minutes;
+	return true;
+}
+
+jsmntok_t *jsmn_borrow() {
+	if (jsmn_lent) {
+		return NULL;
+	}
+	jsmn_lent = true;
+	return jsmn_arena;
+}
+
+void jsmn_return() {
+	jsmn_lent = false;
+}
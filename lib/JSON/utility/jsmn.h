@@ -1,6 +1,16 @@
 #ifndef __JSMN_H_
 #define __JSMN_H_
 
+#include <stdint.h>
+
+/* Tokens in the arena that all parsers share, see jsmn_borrow(), a ruleset needs 63 */
+#ifndef JSMN_ARENA_SIZE
+#define JSMN_ARENA_SIZE 72
+#endif
+
+/* Start or end of a token that is not known yet */
+#define JSMN_NONE 0xFFFF
+
 /**
  * JSON type identifier. Basic types are:
  * 	o Object
@@ -31,14 +41,21 @@ typedef enum {
  * @param		type	type (object, array, string etc.)
  * @param		start	start position in JSON data string
  * @param		end		end position in JSON data string
+ * @param		size	number of children (keys and values count separately)
+ * @param		skip	number of tokens of the value, nested ones included:
+ * 						the next sibling is at token + skip
+ *
+ * Offsets are 16 bit and counts 8 bit, so a token takes 7 bytes on AVR:
+ * JSON texts stay below 64K and a parse never has more than 255 tokens.
  */
 typedef struct {
-	jsmntype_t type;
-	int start;
-	int end;
-	int size;
+	uint16_t start;
+	uint16_t end;
+	uint8_t type : 4;
+	uint8_t size;
+	uint8_t skip;
 #ifdef JSMN_PARENT_LINKS
-	int parent;
+	int16_t parent;
 #endif
 } jsmntok_t;
 
@@ -60,8 +77,38 @@ void jsmn_init(jsmn_parser *parser);
 /**
  * Run JSON parser. It parses a JSON data string into and array of tokens, each describing
  * a single JSON object.
+ *
+ * Parsing stops at the end of the first complete value, at a '\0' or after len
+ * characters. JSMN_ERROR_PART means the value is not complete yet: call it again
+ * with the same parser and tokens when more characters have been appended to js.
+ * A number or other primitive on its own is only complete when a character
+ * follows it.
  */
-jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, 
+jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, unsigned int len,
 		jsmntok_t *tokens, unsigned int num_tokens);
 
+/**
+ * Take the token arena, JSMN_ARENA_SIZE tokens. Returns NULL while another
+ * parser still has it: there is only one, give it back with jsmn_return()
+ * as soon as the tokens are no longer needed.
+ */
+jsmntok_t *jsmn_borrow();
+void jsmn_return();
+
+/**
+ * Typed values of a token. They scan the text between start and end, so js
+ * needs no '\0' after the token and is not changed. A number must be an
+ * integer that fits the type: no spaces, '+', fraction or exponent.
+ * They return false and leave *value as it is when the token does not hold
+ * such a value.
+ */
+bool jsmn_int8(const char *js, const jsmntok_t *tok, int8_t *value);
+bool jsmn_int16(const char *js, const jsmntok_t *tok, int16_t *value);
+bool jsmn_int32(const char *js, const jsmntok_t *tok, int32_t *value);
+/**
+ * A "HH:MM" string as minutes since 00:00. HH can be up to 99, the caller
+ * checks the range of the result.
+ */
+bool jsmn_minutes(const char *js, const jsmntok_t *tok, int16_t *value);
+
 #endif /* __JSMN_H_ */
@@ -0,0 +1,157 @@
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 29-3-2021
+* File : arbiter.cpp
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <string.h>
+#include "arbiter.h"
+#include "logger.h"
+#include "terrarium.h"
+
+/*****************
+    Private data
+******************/
+static_assert(NR_OF_DEVICES <= 8, "a device is a bit in a uint8_t");
+
+static int32_t requests[ARB_NR_OF_SOURCES][NR_OF_DEVICES];
+static uint8_t requested[ARB_NR_OF_SOURCES]; // bit n set: the source has a request for device n
+uint16_t arb_version = 0;
+static bool changed = true;          // the devices have to be resolved again
+static int32_t nextEndTime = 0;      // the earliest end_time > 0 of the requests, 0 = none
+// The most seconds a request was dropped after its end_time. It only grows until
+// arb_init, propertiesVersion() in restserver.cpp relies on that for the ETag.
+static uint16_t maxDelay = 0;
+static time_t lastTick = 0;          // curtime of the previous arb_tick, 0 = none yet
+static uint32_t lastTickMillis = 0;  // millis() at that tick
+
+/**********************
+    Private functions
+**********************/
+// A request by hand for a device in auto mode lasts until another source changes its request
+void arb_endManual(int8_t source, int8_t device) {
+	if (source != ARB_MANUAL && arb_hasRequest(ARB_MANUAL, device) && !gen_isDeviceOnManual(device)) {
+		requested[ARB_MANUAL] &= ~(1 << device);
+	}
+}
+
+// Drop the requests whose end_time has passed and find the next one to end,
+// after a clock jump the delay is not the loop's, so it is not counted
+void arb_expire(time_t curtime, bool jumped) {
+	nextEndTime = 0;
+	for (int8_t s = 0; s < ARB_NR_OF_SOURCES; s++) {
+		for (int8_t d = 0; d < NR_OF_DEVICES; d++) {
+			int32_t end_time = requests[s][d];
+			if (!arb_hasRequest(s, d) || end_time <= 0) {
+				continue;
+			} else if (curtime > end_time) {
+				int32_t delay = curtime - end_time; // 1 when it is dropped in time
+				if (jumped) {
+					logline("Request of %d for device %d dropped after the clock jumped", s, d);
+				} else {
+					if (delay > maxDelay) {
+						maxDelay = (delay > UINT16_MAX ? UINT16_MAX : delay);
+					}
+					if (delay > 1) {
+						logline("WARNING: request of %d for device %d dropped %ld seconds late", s, d, (long)delay);
+					}
+				}
+				arb_release(s, d);
+			} else if (nextEndTime == 0 || end_time < nextEndTime) {
+				nextEndTime = end_time;
+			}
+		}
+	}
+}
+
+/*****************************************************************
+    Public functions (templates in the corresponding header-file)
+******************************************************************/
+void arb_init() {
+	memset(requests, 0, sizeof(requests));
+	memset(requested, 0, sizeof(requested));
+	nextEndTime = 0;
+	maxDelay = 0;
+	lastTick = 0;
+	arb_changed();
+}
+
+void arb_request(int8_t source, int8_t device, int32_t end_time) {
+	if (device == NO_DEVICE || (arb_hasRequest(source, device) && requests[source][device] == end_time)) {
+		return;
+	}
+	arb_endManual(source, device);
+	requests[source][device] = end_time;
+	requested[source] |= 1 << device;
+	if (end_time > 0 && (nextEndTime == 0 || end_time < nextEndTime)) {
+		nextEndTime = end_time;
+	}
+	arb_changed();
+}
+
+void arb_release(int8_t source, int8_t device) {
+	if (device == NO_DEVICE || !arb_hasRequest(source, device)) {
+		return;
+	}
+	arb_endManual(source, device);
+	requested[source] &= ~(1 << device);
+	arb_changed(); // nextEndTime may be earlier than needed now, that only costs one arb_expire
+}
+
+bool arb_hasRequest(int8_t source, int8_t device) {
+	return (requested[source] >> device) & 1;
+}
+
+int32_t arb_getRequest(int8_t source, int8_t device) {
+	return arb_hasRequest(source, device) ? requests[source][device] : 0;
+}
+
+void arb_changed() {
+	changed = true;
+	arb_version++;
+}
+
+void arb_tick(time_t curtime) {
+	// the clock jumped when it went back or ran ahead of millis(), a second of slack for the rounding
+	uint32_t now = millis();
+	bool jumped = lastTick != 0 && (curtime < lastTick || curtime - lastTick > (int32_t)((now - lastTickMillis) / 1000) + 1);
+	lastTick = curtime;
+	lastTickMillis = now;
+	if (nextEndTime > 0 && curtime > nextEndTime) {
+		arb_expire(curtime, jumped);
+	}
+	if (!changed) {
+		return;
+	}
+	changed = false;
+	// the rules wait while the mist is on
+	bool misting = MIST != NO_DEVICE && gen_isDeviceOn(MIST);
+	for (int8_t d = 0; d < NR_OF_DEVICES; d++) {
+		int8_t winner = ARB_NONE;
+		for (int8_t s = 0; s < ARB_NR_OF_SOURCES && winner == ARB_NONE; s++) {
+			if (arb_hasRequest(s, d) && (s == ARB_MANUAL || !gen_isDeviceOnManual(d)) && !(s == ARB_RULE && misting)) {
+				winner = s;
+			}
+		}
+		gen_setDeviceState(d, winner == ARB_NONE ? 0 : requests[winner][d], winner);
+	}
+	if (MIST != NO_DEVICE && gen_isDeviceOn(MIST) != misting) {
+		changed = true; // the rule requests are decided on the old mist state
+	}
+}
+
+uint16_t arb_getVersion() {
+	return arb_version;
+}
+
+uint16_t arb_getMaxDelay() {
+	return maxDelay;
+}
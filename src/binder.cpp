@@ -0,0 +1,217 @@
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 24-3-2021
+* File : binder.cpp
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <stdio.h>
+#include <string.h>
+#include "utility/jsmn.h"
+#include "binder.h"
+#include "expression.h"
+#include "terrarium.h"
+
+/*****************
+    Private data
+******************/
+#define BND_PATH_SIZE 40
+
+/**********************
+    Private functions
+**********************/
+// true if the string token equals s
+bool bnd_equals(const char *json, jsmntok_t *tok, const char *s) {
+	uint8_t len = tok->end - tok->start;
+	return tok->type == JSMN_STRING && strncmp(json + tok->start, s, len) == 0 && s[len] == 0;
+}
+
+bool bnd_device(const char *json, jsmntok_t *tok, int16_t *value) {
+	*value = gen_getDeviceId(json + tok->start, tok->end - tok->start);
+	return tok->type == JSMN_STRING && *value != UNKNOWN_DEVICE;
+}
+
+const char *bnd_object(const Schema *schema, const char *json, jsmntok_t *tok, uint8_t *target, char *path);
+
+// Clear an element of an array that is not sent
+void bnd_clear(const Schema *schema, uint8_t *target, uint8_t size) {
+	memset(target, 0, size);
+	for (uint8_t i = 0; i < schema->nr_of_fields; i++) {
+		const Field *f = &schema->fields[i];
+		if (f->type == BND_DEVICE) {
+			*(int8_t *)(target + f->offset) = NO_DEVICE;
+		} else if (f->type == BND_ARRAY) {
+			for (uint8_t e = 0; e < f->count; e++) {
+				bnd_clear(f->schema, target + f->offset + e * f->size, f->size);
+			}
+		}
+	}
+}
+
+// Bind one value, returns the reason it is rejected or NULL
+const char *bnd_value(const Field *f, const char *json, jsmntok_t *tok, uint8_t *member, char *path) {
+	int16_t v;
+	switch (f->type) {
+	case BND_ARRAY: {
+		if (tok->type != JSMN_ARRAY) {
+			return "array expected";
+		}
+		if (tok->size > f->count) {
+			return "too many elements";
+		}
+		uint8_t len = strlen(path);
+		jsmntok_t *element = tok + 1;
+		for (uint8_t i = 0; i < tok->size; i++) {
+			snprintf(path + len, BND_PATH_SIZE - len, "[%d]", i);
+			const char *reason = bnd_object(f->schema, json, element, member + i * f->size, path);
+			if (reason != NULL) {
+				return reason;
+			}
+			element += element->skip;
+		}
+		for (uint8_t i = tok->size; i < f->count; i++) {
+			bnd_clear(f->schema, member + i * f->size, f->size);
+		}
+		path[len] = 0;
+		return NULL;
+	}
+	case BND_EXPR:
+		if (tok->type != JSMN_STRING) {
+			return "string expected";
+		}
+		if (tok->end - tok->start > XPR_MAX_TEXT) {
+			return "expression too long"; // before its length is cut to a uint8_t
+		}
+		return xpr_compile(json + tok->start, tok->end - tok->start, member);
+	case BND_YESNO:
+		if (!bnd_equals(json, tok, "yes") && !bnd_equals(json, tok, "no")) {
+			return "yes or no expected";
+		}
+		*(bool *)member = bnd_equals(json, tok, "yes");
+		return NULL;
+	case BND_TIME:
+		if (!jsmn_minutes(json, tok, &v)) {
+			return "HH:MM expected";
+		}
+		break;
+	case BND_DEVICE:
+		if (!bnd_device(json, tok, &v)) {
+			return "unknown device";
+		}
+		break;
+	case BND_ENUM:
+		v = f->max;
+		while (v >= 0 && !bnd_equals(json, tok, f->names[v])) {
+			v--;
+		}
+		if (v < 0) {
+			return "unknown value";
+		}
+		break;
+	case BND_FLAGS: {
+		if (tok->type != JSMN_STRING) {
+			return "string expected";
+		}
+		v = 0;
+		const char *name = json + tok->start;
+		const char *end = json + tok->end;
+		while (name < end) {
+			const char *comma = name;
+			while (comma < end && *comma != ',') {
+				comma++;
+			}
+			uint8_t n = 0;
+			while ((1 << n) <= f->max && (strncmp(f->names[n], name, comma - name) != 0 || f->names[n][comma - name] != 0)) {
+				n++;
+			}
+			if ((1 << n) > f->max) {
+				return "unknown value";
+			}
+			v |= 1 << n;
+			name = comma + 1;
+		}
+		break;
+	}
+	default:
+		if (!jsmn_int16(json, tok, &v)) {
+			return "number expected";
+		}
+		break;
+	}
+	if (f->type != BND_DEVICE && (v < f->min || v > f->max)) {
+		return "out of range";
+	}
+	if (f->type == BND_INT8 || f->type == BND_DEVICE || f->type == BND_ENUM || f->type == BND_FLAGS) {
+		*(int8_t *)member = v;
+		return NULL;
+	}
+	// an int16_t member of a packed struct may be at an odd address
+	int16_t minutes;
+	memcpy(&minutes, member, sizeof(minutes));
+	if (f->type == BND_HOUR) {
+		v = v * 60 + minutes % 60;
+	} else if (f->type == BND_MINUTE) {
+		v = minutes - minutes % 60 + v;
+	}
+	memcpy(member, &v, sizeof(v));
+	return NULL;
+}
+
+// Bind the members of an object, path is extended with the key that is bound
+const char *bnd_object(const Schema *schema, const char *json, jsmntok_t *tok, uint8_t *target, char *path) {
+	if (tok->type != JSMN_OBJECT) {
+		return "object expected";
+	}
+	uint8_t len = strlen(path);
+	jsmntok_t *key = tok + 1;
+	for (int16_t i = 0; i < tok->size / 2; i++) {
+		jsmntok_t *value = key + 1;
+		for (uint8_t f = 0; f < schema->nr_of_fields; f++) {
+			const Field *field = &schema->fields[f];
+			if (bnd_equals(json, key, field->name)) {
+				snprintf(path + len, BND_PATH_SIZE - len, len == 0 ? "%s" : ".%s", field->name);
+				const char *reason = bnd_value(field, json, value, target + field->offset, path);
+				if (reason != NULL) {
+					return reason;
+				}
+				path[len] = 0;
+				break;
+			}
+		}
+		key = value + value->skip;
+	}
+	return NULL;
+}
+
+/*****************************************************************
+    Public functions (templates in the corresponding header-file)
+******************************************************************/
+bool bnd_fromJson(const Schema *schema, const char *json, void *target, char *error) {
+	jsmntok_t *tokens = jsmn_borrow();
+	if (tokens == NULL) {
+		strcpy(error, "The parser is busy");
+		return false;
+	}
+	jsmn_parser parser;
+	jsmn_init(&parser);
+	if (jsmn_parse(&parser, json, strlen(json), tokens, JSMN_ARENA_SIZE) != JSMN_SUCCESS || parser.toknext == 0) {
+		jsmn_return();
+		strcpy(error, "Could not deserialize the JSON");
+		return false;
+	}
+	char path[BND_PATH_SIZE] = "";
+	const char *reason = bnd_object(schema, json, tokens, (uint8_t *)target, path);
+	jsmn_return();
+	if (reason != NULL) {
+		snprintf(error, BND_ERROR_SIZE, "%s: %s", path[0] == 0 ? "body" : path, reason);
+		return false;
+	}
+	return true;
+}
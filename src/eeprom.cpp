@@ -14,6 +14,7 @@
 ******************/
 #include <stdint.h>
 #include <EEPROM.h>
+#include "eeprom.h"
 #include "logger.h"
 #include "terrarium.h"
 #include "rules.h"
@@ -27,9 +28,13 @@
 #define ADDRESS_NR_OF_RULESETS 2
 #define ADDRESS_START_ADDRESS_RULESETS 3
 #define ADDRESS_START_ADDRESS_SPRAYER_RULE 4
+// The start addresses are still written for older readers, the layout itself
+// comes from eeprom.h, so an address left by an older layout is never used.
+
+static_assert(sizeof(Timer) == EPR_TIMER_SIZE, "a timer must fit its EEPROM slot");
+static_assert(sizeof(SprayerRule) == EPR_SPRAYER_RULE_SIZE, "the sprayer rule must fit its EEPROM slot");
 
 int8_t timerSize;
-int8_t rulesetSize;
 int8_t sprayerRuleSize;
 
 /**********************
@@ -40,9 +45,8 @@ int8_t sprayerRuleSize;
     Public functions (templates in the corresponding header-file)
 ******************************************************************/
 void epr_init() {
-	timerSize = 9;	  //sizeof(Timer);
-	rulesetSize = 33; //sizeof(RuleSet);
-	sprayerRuleSize = 13; //sizeof(SprayerRule)
+	timerSize = EPR_TIMER_SIZE;
+	sprayerRuleSize = EPR_SPRAYER_RULE_SIZE;
 #ifdef INIT_EEPROM
     for (int i = 0 ; i < EEPROM.length() ; i++) {
         EEPROM.write(i, 0);
@@ -58,66 +62,64 @@ int8_t epr_getNrOfRulesetsStored() {
 }
 void epr_setNrOfTimersStored(int8_t nr) {
 	EEPROM.update(ADDRESS_NR_OF_TIMERS, nr);
-	EEPROM.update(ADDRESS_START_ADDRESS_TIMERS, 5);
+	EEPROM.update(ADDRESS_START_ADDRESS_TIMERS, EPR_ADDRESS_TIMERS);
 }
 void epr_setNrOfRulesetsStored(int8_t nr) {
     EEPROM.update(ADDRESS_NR_OF_RULESETS, nr);
-    EEPROM.update(ADDRESS_START_ADDRESS_RULESETS, 167);
-    EEPROM.update(ADDRESS_START_ADDRESS_SPRAYER_RULE, 233);
+    EEPROM.update(ADDRESS_START_ADDRESS_RULESETS, EPR_ADDRESS_RULESETS);
+    EEPROM.update(ADDRESS_START_ADDRESS_SPRAYER_RULE, EPR_ADDRESS_SPRAYER_RULE);
 }
 void epr_saveTimerToEEPROM(int8_t i, Timer *t) {
-	uint8_t ix = EEPROM.read(ADDRESS_START_ADDRESS_TIMERS);
-	ix += timerSize * i;
+	uint8_t ix = EPR_ADDRESS_TIMERS + timerSize * i;
 	EEPROM.put(ix, *t);
 }
 void epr_getTimerFromEEPROM(int8_t i, Timer *t) {
-    uint8_t ix = EEPROM.read(ADDRESS_START_ADDRESS_TIMERS);
-    ix += timerSize * i;
+    uint8_t ix = EPR_ADDRESS_TIMERS + timerSize * i;
     EEPROM.get(ix, *t);
 }
-void epr_saveRulesetToEEPROM(int8_t i, RuleSet *rs) {
-    uint8_t ix = EEPROM.read(ADDRESS_START_ADDRESS_RULESETS);
-	ix += rulesetSize * i;
-	EEPROM.put(ix, *rs);
+void epr_saveRulesetsToEEPROM(const uint8_t *rulesets) {
+    uint8_t ix = EPR_ADDRESS_RULESETS;
+	for (uint8_t i = 0; i < EPR_RULESETS_SIZE; i++) {
+		EEPROM.update(ix + i, rulesets[i]); // only the bytes that changed are written
+	}
 }
-void epr_getRulesetFromEEPROM(int8_t i, RuleSet *rs) {
-    uint8_t ix = EEPROM.read(ADDRESS_START_ADDRESS_RULESETS);
-	ix += rulesetSize * i;
-	EEPROM.get(ix, *rs);
+void epr_getRulesetsFromEEPROM(uint8_t *rulesets) {
+    uint8_t ix = EPR_ADDRESS_RULESETS;
+	for (uint8_t i = 0; i < EPR_RULESETS_SIZE; i++) {
+		rulesets[i] = EEPROM.read(ix + i);
+	}
 }
 void epr_saveSprayerRuleToEEPROM(SprayerRule *sr) {
-    uint8_t ix = EEPROM.read(ADDRESS_START_ADDRESS_SPRAYER_RULE);
-	EEPROM.put(ix, *sr);
+	EEPROM.put(EPR_ADDRESS_SPRAYER_RULE, *sr);
 }
 void epr_getSprayerRuleFromEEPROM(SprayerRule *sr) {
-    uint8_t ix = EEPROM.read(ADDRESS_START_ADDRESS_SPRAYER_RULE);
-	EEPROM.get(ix, *sr);
+	EEPROM.get(EPR_ADDRESS_SPRAYER_RULE, *sr);
 }
 void epr_clearHoursOn() {
 	int32_t value = 0;
-    EEPROM.put(248, value);
-    EEPROM.put(252, value);
+    EEPROM.put(EPR_ADDRESS_COUNTERS, value);
+    EEPROM.put(EPR_ADDRESS_COUNTERS + 4, value);
 }
 void epr_setHoursOn(int32_t nrOfHours) {
     int32_t value;
-    EEPROM.get(248, value);
-    EEPROM.put(248, value + 1); // Increase nr of EEPROM writes
-    EEPROM.put(252, nrOfHours); // Set counter
+    EEPROM.get(EPR_ADDRESS_COUNTERS, value);
+    EEPROM.put(EPR_ADDRESS_COUNTERS, value + 1); // Increase nr of EEPROM writes
+    EEPROM.put(EPR_ADDRESS_COUNTERS + 4, nrOfHours); // Set counter
 }
 void epr_decreaseHoursOn(int32_t nrOfHours) {
 	int32_t value;
-    EEPROM.get(248, value);
-    EEPROM.put(248, value + 1); // Increase nr of EEPROM writes
-	EEPROM.get(252, value);
-    EEPROM.put(252, value - nrOfHours); // Decrease counter
+    EEPROM.get(EPR_ADDRESS_COUNTERS, value);
+    EEPROM.put(EPR_ADDRESS_COUNTERS, value + 1); // Increase nr of EEPROM writes
+	EEPROM.get(EPR_ADDRESS_COUNTERS + 4, value);
+    EEPROM.put(EPR_ADDRESS_COUNTERS + 4, value - nrOfHours); // Decrease counter
 }
 int32_t epr_getHoursOn() {
 	int32_t value;
-	EEPROM.get(252, value);
+	EEPROM.get(EPR_ADDRESS_COUNTERS + 4, value);
 	return value;
 }
 uint32_t epr_getEEPROMWriteCounter() {
     uint32_t value;
-    EEPROM.get(248, value);
+    EEPROM.get(EPR_ADDRESS_COUNTERS, value);
     return value;
 }
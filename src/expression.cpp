@@ -0,0 +1,371 @@
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 28-3-2021
+* File : expression.cpp
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include "expression.h"
+
+/*****************
+    Private data
+******************/
+const char *const varNames[XPR_NR_OF_VARS] = {"terrarium_temp", "room_temp", "room_hum", "minute_of_day"};
+// Text of the instructions XPR_LT up to XPR_OR
+const char *const opNames[] = {"<", "<=", ">", ">=", "==", "!="};
+
+typedef struct {
+	const char *s;          // what is not compiled yet
+	const char *end;
+	uint8_t *code;          // code[0] is the length of the bytecode
+	uint8_t depth;          // of the stack when the code so far runs
+	uint8_t nesting;        // of parentheses and '!', it limits the recursion
+	const char *error;      // the first error
+} Compiler;
+
+/**********************
+    Private functions
+**********************/
+void xpr_error(Compiler *c, const char *error) {
+	if (c->error == NULL) {
+		c->error = error;
+	}
+}
+
+void xpr_emit(Compiler *c, uint8_t byte) {
+	if (c->code[0] == XPR_MAX_CODE) {
+		xpr_error(c, "expression too long");
+		return;
+	}
+	c->code[++c->code[0]] = byte;
+}
+
+// An instruction that changes the stack depth with delta
+void xpr_op(Compiler *c, uint8_t op, int8_t delta) {
+	xpr_emit(c, op);
+	c->depth += delta;
+	if (c->depth > XPR_STACK) {
+		xpr_error(c, "expression too deep");
+	}
+}
+
+void xpr_skipSpace(Compiler *c) {
+	while (c->s < c->end && *c->s == ' ') {
+		c->s++;
+	}
+}
+
+bool xpr_isNameChar(char ch) {
+	return isalnum(ch) || ch == '_';
+}
+
+// Skip tok if it is next, a word must not be followed by more letters
+bool xpr_accept(Compiler *c, const char *tok) {
+	xpr_skipSpace(c);
+	uint8_t len = strlen(tok);
+	if (c->end - c->s < len || strncmp(c->s, tok, len) != 0) {
+		return false;
+	}
+	if (xpr_isNameChar(tok[0]) && c->s + len < c->end && xpr_isNameChar(c->s[len])) {
+		return false;
+	}
+	c->s += len;
+	return true;
+}
+
+void xpr_number(Compiler *c) {
+	xpr_skipSpace(c);
+	bool neg = (c->s < c->end && *c->s == '-');
+	const char *p = c->s + (neg ? 1 : 0);
+	int32_t v = 0;
+	if (p == c->end || !isdigit(*p)) {
+		xpr_error(c, "syntax error");
+		return;
+	}
+	while (p < c->end && isdigit(*p)) {
+		v = v * 10 + (*p++ - '0');
+		if (v > INT16_MAX) {
+			xpr_error(c, "number out of range");
+			return;
+		}
+	}
+	c->s = p;
+	v = (neg ? -v : v);
+	if (v >= INT8_MIN && v <= INT8_MAX) {
+		xpr_op(c, XPR_CONST8, 1);
+		xpr_emit(c, v);
+	} else {
+		xpr_op(c, XPR_CONST16, 1);
+		xpr_emit(c, v);
+		xpr_emit(c, v >> 8);
+	}
+}
+
+void xpr_or(Compiler *c);
+
+// primary := name | number | '(' or ')' , unary := '!' unary | primary
+void xpr_unary(Compiler *c) {
+	if (c->nesting == XPR_STACK) {
+		xpr_error(c, "expression too deep");
+		return;
+	}
+	c->nesting++;
+	xpr_skipSpace(c);
+	if (xpr_accept(c, "!")) {
+		xpr_unary(c);
+		xpr_op(c, XPR_NOT, 0);
+	} else if (xpr_accept(c, "(")) {
+		xpr_or(c);
+		if (!xpr_accept(c, ")")) {
+			xpr_error(c, "syntax error");
+		}
+	} else if (c->s < c->end && (isdigit(*c->s) || *c->s == '-')) {
+		xpr_number(c);
+	} else {
+		for (uint8_t v = 0; v < XPR_NR_OF_VARS; v++) {
+			if (xpr_accept(c, varNames[v])) {
+				xpr_op(c, XPR_VAR + v, 1);
+				break;
+			} else if (v == XPR_NR_OF_VARS - 1) {
+				xpr_error(c, c->s < c->end && xpr_isNameChar(*c->s) ? "unknown name" : "syntax error");
+			}
+		}
+	}
+	c->nesting--;
+}
+
+// compare := unary [('<' | '<=' | ...) unary | 'in' '[' number ',' number ']']
+void xpr_compare(Compiler *c) {
+	xpr_unary(c);
+	if (xpr_accept(c, "in")) {
+		if (!xpr_accept(c, "[")) {
+			xpr_error(c, "syntax error");
+		}
+		xpr_number(c);
+		if (!xpr_accept(c, ",")) {
+			xpr_error(c, "syntax error");
+		}
+		xpr_number(c);
+		if (!xpr_accept(c, "]")) {
+			xpr_error(c, "syntax error");
+		}
+		xpr_op(c, XPR_IN, -2);
+		return;
+	}
+	// the 2 character operators first
+	const uint8_t order[] = {XPR_LE, XPR_GE, XPR_EQ, XPR_NE, XPR_LT, XPR_GT};
+	for (uint8_t i = 0; i < sizeof(order); i++) {
+		if (xpr_accept(c, opNames[order[i] - XPR_LT])) {
+			xpr_unary(c);
+			xpr_op(c, order[i], -1);
+			return;
+		}
+	}
+}
+
+void xpr_and(Compiler *c) {
+	xpr_compare(c);
+	while (c->error == NULL && xpr_accept(c, "&&")) {
+		xpr_compare(c);
+		xpr_op(c, XPR_AND, -1);
+	}
+}
+
+void xpr_or(Compiler *c) {
+	xpr_and(c);
+	while (c->error == NULL && xpr_accept(c, "||")) {
+		xpr_and(c);
+		xpr_op(c, XPR_OR, -1);
+	}
+}
+
+// Nr of values an instruction takes from the stack
+uint8_t xpr_arity(uint8_t op) {
+	return (op == XPR_IN ? 3 : (op == XPR_NOT ? 1 : (op >= XPR_LT ? 2 : 0)));
+}
+
+// Operators that bind less get a lower number
+uint8_t xpr_precedence(uint8_t op) {
+	return (op == XPR_OR ? 1 : (op == XPR_AND ? 2 : (op == XPR_NOT ? 4 : (op >= XPR_LT ? 3 : 5))));
+}
+
+// The first instruction of the part of the expression that ends with instruction i
+uint8_t xpr_start(const uint8_t *code, const uint8_t *ops, uint8_t i) {
+	uint8_t j = i;
+	for (uint8_t k = 0; k < xpr_arity(code[ops[i]]); k++) {
+		j = xpr_start(code, ops, j - 1);
+	}
+	return j;
+}
+
+typedef struct {
+	char *text;
+	uint16_t len;           // can be more than XPR_MAX_TEXT, the text is then cut off
+} Text;
+
+void xpr_append(Text *t, const char *s) {
+	t->len += snprintf(t->text + (t->len < XPR_MAX_TEXT ? t->len : XPR_MAX_TEXT),
+		(t->len < XPR_MAX_TEXT ? XPR_MAX_TEXT - t->len + 1 : 1), "%s", s);
+}
+
+// Write the part that ends with instruction i, in parentheses when it binds less than prec
+void xpr_print(const uint8_t *code, const uint8_t *ops, uint8_t i, uint8_t prec, Text *t) {
+	uint8_t op = code[ops[i]];
+	char tmp[8];
+	bool parens = xpr_precedence(op) < prec;
+	if (parens) {
+		xpr_append(t, "(");
+	}
+	if (op < XPR_CONST8) {
+		xpr_append(t, varNames[op - XPR_VAR]);
+	} else if (op == XPR_CONST8) {
+		sprintf(tmp, "%d", (int8_t)code[ops[i] + 1]);
+		xpr_append(t, tmp);
+	} else if (op == XPR_CONST16) {
+		sprintf(tmp, "%d", (int16_t)(code[ops[i] + 1] | code[ops[i] + 2] << 8));
+		xpr_append(t, tmp);
+	} else if (op == XPR_NOT) {
+		xpr_append(t, "!");
+		xpr_print(code, ops, i - 1, 4, t);
+	} else if (op == XPR_IN) {
+		uint8_t hi = i - 1;
+		uint8_t lo = xpr_start(code, ops, hi) - 1;
+		xpr_print(code, ops, xpr_start(code, ops, lo) - 1, 4, t);
+		xpr_append(t, " in [");
+		xpr_print(code, ops, lo, 0, t);
+		xpr_append(t, ",");
+		xpr_print(code, ops, hi, 0, t);
+		xpr_append(t, "]");
+	} else {
+		// a comparison does not take another comparison without parentheses
+		uint8_t right = i - 1;
+		uint8_t left = xpr_start(code, ops, right) - 1;
+		uint8_t p = xpr_precedence(op);
+		xpr_print(code, ops, left, (op == XPR_AND || op == XPR_OR ? p : p + 1), t);
+		xpr_append(t, op == XPR_AND ? " && " : (op == XPR_OR ? " || " : " "));
+		if (op != XPR_AND && op != XPR_OR) {
+			xpr_append(t, opNames[op - XPR_LT]);
+			xpr_append(t, " ");
+		}
+		xpr_print(code, ops, right, p + 1, t);
+	}
+	if (parens) {
+		xpr_append(t, ")");
+	}
+}
+
+/*****************************************************************
+    Public functions (templates in the corresponding header-file)
+******************************************************************/
+const char *xpr_compile(const char *text, uint8_t len, uint8_t *code) {
+	Compiler c = {text, text + len, code, 0, 0, NULL};
+	code[0] = 0;
+	xpr_skipSpace(&c);
+	if (c.s == c.end) {
+		return NULL; // no expression
+	}
+	xpr_or(&c);
+	xpr_skipSpace(&c);
+	if (c.s != c.end) {
+		xpr_error(&c, "syntax error");
+	}
+	if (c.error == NULL) {
+		// it must also fit when it is written as text again
+		char tmp[XPR_MAX_TEXT + 1];
+		if (xpr_toText(code + 1, code[0], tmp) > XPR_MAX_TEXT) {
+			xpr_error(&c, "expression too long");
+		}
+	}
+	return c.error;
+}
+
+bool xpr_isValid(const uint8_t *code, uint8_t len) {
+	uint8_t depth = 0;
+	if (len > XPR_MAX_CODE) {
+		return false;
+	}
+	for (uint8_t pc = 0; pc < len; pc++) {
+		uint8_t op = code[pc];
+		if (op < XPR_VAR + XPR_NR_OF_VARS) {
+			depth++;
+		} else if (op == XPR_CONST8 || op == XPR_CONST16) {
+			pc += (op == XPR_CONST8 ? 1 : 2);
+			if (pc >= len) {
+				return false;
+			}
+			depth++;
+		} else if (op >= XPR_LT && op <= XPR_IN) {
+			if (depth < xpr_arity(op)) {
+				return false;
+			}
+			depth -= xpr_arity(op) - 1;
+		} else {
+			return false;
+		}
+		if (depth > XPR_STACK) {
+			return false;
+		}
+	}
+	return depth == 1;
+}
+
+int16_t xpr_run(const uint8_t *code, uint8_t len, const int16_t *vars) {
+	int16_t stack[XPR_STACK];
+	int8_t sp = -1;         // top of the stack
+	for (uint8_t pc = 0; pc < len; pc++) {
+		uint8_t op = code[pc];
+		if (op < XPR_CONST8) {
+			stack[++sp] = vars[op - XPR_VAR];
+			continue;
+		} else if (op == XPR_CONST8) {
+			stack[++sp] = (int8_t)code[++pc];
+			continue;
+		} else if (op == XPR_CONST16) {
+			stack[++sp] = (int16_t)(code[pc + 1] | code[pc + 2] << 8);
+			pc += 2;
+			continue;
+		} else if (op == XPR_NOT) {
+			stack[sp] = !stack[sp];
+			continue;
+		} else if (op == XPR_IN) {
+			sp -= 2;
+			stack[sp] = stack[sp + 1] <= stack[sp] && stack[sp] <= stack[sp + 2];
+			continue;
+		}
+		int16_t b = stack[sp--];
+		int16_t a = stack[sp];
+		switch (op) {
+		case XPR_LT: stack[sp] = a < b; break;
+		case XPR_LE: stack[sp] = a <= b; break;
+		case XPR_GT: stack[sp] = a > b; break;
+		case XPR_GE: stack[sp] = a >= b; break;
+		case XPR_EQ: stack[sp] = a == b; break;
+		case XPR_NE: stack[sp] = a != b; break;
+		case XPR_AND: stack[sp] = a && b; break;
+		case XPR_OR: stack[sp] = a || b; break;
+		}
+	}
+	return stack[0];
+}
+
+uint16_t xpr_toText(const uint8_t *code, uint8_t len, char *text) {
+	uint8_t ops[XPR_MAX_CODE];  // where each instruction starts
+	uint8_t n = 0;
+	for (uint8_t pc = 0; pc < len; pc += (code[pc] == XPR_CONST8 ? 2 : (code[pc] == XPR_CONST16 ? 3 : 1))) {
+		ops[n++] = pc;
+	}
+	Text t = {text, 0};
+	text[0] = 0;
+	xpr_print(code, ops, n - 1, 0, &t);
+	return t.len;
+}
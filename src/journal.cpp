@@ -0,0 +1,119 @@
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 21-3-2021
+* File : journal.cpp
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include "journal.h"
+#include "rules.h"
+#include "terrarium.h"
+
+/*****************
+    Private data
+******************/
+Change changes[JRN_SIZE];  // ring, change seq is at changes[seq % JRN_SIZE]
+uint32_t jrn_seq = 0;
+
+const char *sensorNames[] = {"room_temp", "room_hum", "terrarium_temp"};
+
+/**********************
+    Private functions
+**********************/
+
+/*****************************************************************
+    Public functions (templates in the corresponding header-file)
+******************************************************************/
+void jrn_add(uint8_t kind, int8_t subject, int32_t value) {
+	jrn_seq++;
+	Change *change = &changes[jrn_seq % JRN_SIZE];
+	change->kind = kind;
+	change->subject = subject;
+	change->value = value;
+}
+
+uint32_t jrn_getSeq() {
+	return jrn_seq;
+}
+
+uint16_t jrn_getVersion() {
+	return (uint16_t)jrn_seq;
+}
+
+bool jrn_get(uint32_t seq, Change *change) {
+	if (seq == 0 || seq > jrn_seq || jrn_seq - seq >= JRN_SIZE) {
+		return false;
+	}
+	*change = changes[seq % JRN_SIZE];
+	return true;
+}
+
+void jrn_getChangeAsJson(uint32_t seq, Change *change, JsonWriter *jw) {
+	jw_beginObject(jw);
+	jw_long(jw, "seq", seq);
+	switch (change->kind) {
+	case JRN_DEVICE:
+		jw_string(jw, "type", "device");
+		jw_string(jw, "device", gen_getDevices()[change->subject].name);
+		jw_string(jw, "state", change->value == 0 ? "off" : "on");
+		jw_long(jw, "end_time", change->value);
+		break;
+	case JRN_MANUAL:
+		jw_string(jw, "type", "manual");
+		jw_string(jw, "device", gen_getDevices()[change->subject].name);
+		jw_string(jw, "manual", change->value ? "yes" : "no");
+		break;
+	case JRN_TIMERS:
+		jw_string(jw, "type", "timers");
+		jw_string(jw, "device", gen_getDevices()[change->subject].name);
+		break;
+	case JRN_RULESET:
+		jw_string(jw, "type", "ruleset");
+		jw_long(jw, "setnr", change->subject + 1);
+		break;
+	case JRN_SPRAYERRULE:
+		jw_string(jw, "type", "sprayerrule");
+		break;
+	case JRN_SENSOR:
+		jw_string(jw, "type", "sensor");
+		jw_string(jw, "sensor", sensorNames[change->subject]);
+		jw_long(jw, "value", change->value);
+		break;
+	case JRN_THRESHOLD:
+		jw_string(jw, "type", "threshold");
+		jw_long(jw, "setnr", change->subject / RLS_MAX_RULES + 1);
+		jw_long(jw, "rule", change->subject % RLS_MAX_RULES + 1);
+		jw_bool(jw, "crossed", change->value);
+		break;
+	case JRN_SPRAYER_RUN:
+		jw_string(jw, "type", "sprayer");
+		jw_bool(jw, "active", change->value);
+		break;
+	}
+	jw_endObject(jw);
+}
+
+void jrn_getChangesAsJson(uint32_t since, JsonWriter *jw) {
+	jw_beginObject(jw);
+	jw_long(jw, "seq", jrn_seq);
+	// a client that is ahead of us has seen a previous run
+	if (since > jrn_seq || jrn_seq - since > JRN_SIZE) {
+		jw_bool(jw, "resync", true);
+	} else {
+		jw_key(jw, "changes");
+		jw_beginArray(jw);
+		Change change;
+		for (uint32_t seq = since + 1; jrn_get(seq, &change); seq++) {
+			jrn_getChangeAsJson(seq, &change, jw);
+		}
+		jw_endArray(jw);
+	}
+	jw_endObject(jw);
+}
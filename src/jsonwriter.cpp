@@ -0,0 +1,342 @@
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 20-3-2021
+* File : jsonwriter.cpp
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "jsonwriter.h"
+
+/*****************
+    Private data
+******************/
+
+/**********************
+    Private functions
+**********************/
+void jw_put(JsonWriter *jw, char c) {
+	if (jw->len == JW_BUFFER_SIZE) {
+		jw_flush(jw);
+	}
+	jw->buf[jw->len++] = c;
+	jw->total++;
+}
+
+void jw_puts(JsonWriter *jw, const char *s) {
+	while (*s) {
+		jw_put(jw, *s++);
+	}
+}
+
+// CBOR: the head of an item, major type and argument
+void jw_head(JsonWriter *jw, uint8_t major, uint32_t arg) {
+	major <<= 5;
+	if (arg < 24) {
+		jw_put(jw, major | arg);
+	} else if (arg < 0x100) {
+		jw_put(jw, major | 24);
+		jw_put(jw, arg);
+	} else if (arg < 0x10000) {
+		jw_put(jw, major | 25);
+		jw_put(jw, arg >> 8);
+		jw_put(jw, arg);
+	} else {
+		jw_put(jw, major | 26);
+		jw_put(jw, arg >> 24);
+		jw_put(jw, arg >> 16);
+		jw_put(jw, arg >> 8);
+		jw_put(jw, arg);
+	}
+}
+
+// Write the ',' between two values on the same nesting level
+void jw_separate(JsonWriter *jw) {
+	if (jw->cbor) {
+		return; // CBOR items need no separator
+	}
+	if (jw->afterKey) {
+		jw->afterKey = false;
+		return;
+	}
+	uint8_t bit = 1 << jw->depth;
+	if (jw->first & bit) {
+		jw->first &= ~bit;
+	} else {
+		jw_put(jw, ',');
+	}
+}
+
+void jw_quoted(JsonWriter *jw, const char *s, uint16_t len) {
+	if (jw->cbor) {
+		jw_head(jw, 3, len);
+		while (len--) {
+			jw_put(jw, *s++);
+		}
+		return;
+	}
+	jw_put(jw, '"');
+	for (; len > 0; s++, len--) {
+		if (*s == '"' || *s == '\\') {
+			jw_put(jw, '\\');
+			jw_put(jw, *s);
+		} else if ((uint8_t)*s < 0x20) {
+			char tmp[7];
+			sprintf(tmp, "\\u%04x", *s);
+			jw_puts(jw, tmp);
+		} else {
+			jw_put(jw, *s);
+		}
+	}
+	jw_put(jw, '"');
+}
+
+void jw_begin(JsonWriter *jw, char c) {
+	jw_separate(jw);
+	if (jw->cbor) {
+		jw_put(jw, c == '{' ? 0xBF : 0x9F); // map or array of indefinite length
+	} else {
+		jw_put(jw, c);
+	}
+	if (jw->depth < JW_MAX_DEPTH - 1) {
+		jw->depth++;
+	}
+	jw->first |= 1 << jw->depth;
+}
+
+void jw_close(JsonWriter *jw, char c) {
+	jw->first &= ~(1 << jw->depth);
+	if (jw->depth > 0) {
+		jw->depth--;
+	}
+	jw_put(jw, jw->cbor ? 0xFF : c);
+}
+
+// Write the CBOR item at *p as JSON
+bool jw_cborItem(JsonWriter *jw, const uint8_t **p, const uint8_t *end, uint8_t depth) {
+	uint8_t major;
+	uint32_t arg;
+	bool indefinite;
+	do { // a tag is skipped in this loop, not by recursion, only its content counts
+		if (*p >= end) {
+			return false;
+		}
+		major = **p >> 5;
+		uint8_t info = *(*p)++ & 0x1F;
+		arg = info;
+		indefinite = (info == 31);
+		if (indefinite && major != 4 && major != 5) {
+			return false; // only maps and arrays may have an indefinite length
+		} else if (info >= 24 && info <= 26) {
+			uint8_t n = 1 << (info - 24);
+			if (end - *p < n) {
+				return false;
+			}
+			for (arg = 0; n > 0; n--) {
+				arg = (arg << 8) | *(*p)++;
+			}
+		} else if (info > 26 && !indefinite) {
+			return false; // 64 bit values are not used
+		}
+	} while (major == 6);
+	switch (major) {
+	case 0: // unsigned integer
+	case 1: // negative integer
+		if (arg > INT32_MAX) {
+			return false;
+		}
+		jw_long(jw, major == 0 ? (int32_t)arg : -1 - (int32_t)arg);
+		return true;
+	case 3: // text string
+		if ((uint32_t)(end - *p) < arg) {
+			return false;
+		}
+		jw_separate(jw);
+		jw_quoted(jw, (const char *)*p, arg);
+		*p += arg;
+		return true;
+	case 4: // array
+	case 5: // map
+		if (depth >= JW_MAX_DEPTH - 1) {
+			return false;
+		}
+		jw_begin(jw, major == 4 ? '[' : '{');
+		for (uint32_t i = 0; indefinite || i < arg; i++) {
+			if (indefinite && *p < end && **p == 0xFF) {
+				(*p)++;
+				break;
+			}
+			if (major == 5) {
+				// JSON keys are strings
+				if (*p >= end || (**p >> 5) != 3 || !jw_cborItem(jw, p, end, depth + 1)) {
+					return false;
+				}
+				jw_put(jw, ':');
+				jw->afterKey = true;
+			}
+			if (!jw_cborItem(jw, p, end, depth + 1)) {
+				return false;
+			}
+		}
+		jw_close(jw, major == 4 ? ']' : '}');
+		return true;
+	case 7: // false, true, null
+		if (arg == 20 || arg == 21) {
+			jw_bool(jw, arg == 21);
+			return true;
+		} else if (arg == 22) {
+			jw_separate(jw);
+			jw_puts(jw, "null");
+			return true;
+		}
+		return false;
+	default: // byte strings are not used
+		return false;
+	}
+}
+
+/*****************************************************************
+    Public functions (templates in the corresponding header-file)
+******************************************************************/
+void jw_init(JsonWriter *jw, Print *out, bool chunked, bool cbor) {
+	jw->out = out;
+	jw->chunked = chunked;
+	jw->cbor = cbor;
+	jw->len = 0;
+	jw->depth = 0;
+	jw->first = 1;
+	jw->afterKey = false;
+	jw->total = 0;
+}
+
+void jw_flush(JsonWriter *jw) {
+	if (jw->len == 0) {
+		return;
+	}
+	if (jw->chunked) {
+		jw->out->print((unsigned int)jw->len, HEX);
+		jw->out->print("\r\n");
+	}
+	jw->out->write((const uint8_t *)jw->buf, jw->len);
+	if (jw->chunked) {
+		jw->out->print("\r\n");
+	}
+	jw->len = 0;
+}
+
+void jw_end(JsonWriter *jw) {
+	jw_flush(jw);
+	if (jw->chunked) {
+		jw->out->print("0\r\n\r\n");
+	}
+}
+
+void jw_beginObject(JsonWriter *jw) {
+	jw_begin(jw, '{');
+}
+
+void jw_endObject(JsonWriter *jw) {
+	jw_close(jw, '}');
+}
+
+void jw_beginArray(JsonWriter *jw) {
+	jw_begin(jw, '[');
+}
+
+void jw_endArray(JsonWriter *jw) {
+	jw_close(jw, ']');
+}
+
+void jw_key(JsonWriter *jw, const char *key) {
+	jw_separate(jw);
+	jw_quoted(jw, key, strlen(key));
+	if (!jw->cbor) {
+		jw_put(jw, ':');
+	}
+	jw->afterKey = true;
+}
+
+void jw_string(JsonWriter *jw, const char *value) {
+	jw_separate(jw);
+	jw_quoted(jw, value, strlen(value));
+}
+
+void jw_string(JsonWriter *jw, const char *key, const char *value) {
+	jw_key(jw, key);
+	jw_string(jw, value);
+}
+
+void jw_stringf(JsonWriter *jw, const char *key, const char *format, ...) {
+	char tmp[32];
+	va_list l_Arg;
+	va_start(l_Arg, format);
+	vsnprintf(tmp, sizeof(tmp), format, l_Arg);
+	va_end(l_Arg);
+	jw_string(jw, key, tmp);
+}
+
+void jw_long(JsonWriter *jw, int32_t value) {
+	char tmp[12];
+	jw_separate(jw);
+	if (jw->cbor) {
+		if (value < 0) {
+			jw_head(jw, 1, -1 - value);
+		} else {
+			jw_head(jw, 0, value);
+		}
+		return;
+	}
+	sprintf(tmp, "%ld", (long)value);
+	jw_puts(jw, tmp);
+}
+
+void jw_long(JsonWriter *jw, const char *key, int32_t value) {
+	jw_key(jw, key);
+	jw_long(jw, value);
+}
+
+void jw_bool(JsonWriter *jw, bool value) {
+	jw_separate(jw);
+	if (jw->cbor) {
+		jw_put(jw, value ? 0xF5 : 0xF4);
+		return;
+	}
+	jw_puts(jw, value ? "true" : "false");
+}
+
+void jw_bool(JsonWriter *jw, const char *key, bool value) {
+	jw_key(jw, key);
+	jw_bool(jw, value);
+}
+
+bool jw_fromCbor(JsonWriter *jw, const uint8_t **cbor, const uint8_t *end) {
+	return !jw->cbor && jw_cborItem(jw, cbor, end, 0);
+}
+
+uint8_t jw_matchCborType(uint8_t matched, char c) {
+	const char *type = JW_CBOR_TYPE;
+	while (matched < JW_CBOR_MATCHED) {
+		if (c == type[matched]) {
+			return matched + 1;
+		}
+		if (matched == 0) {
+			return 0;
+		}
+		// continue with the longest start of the type that ends what is matched
+		uint8_t k = matched - 1;
+		while (k > 0 && strncmp(type, type + matched - k, k) != 0) {
+			k--;
+		}
+		matched = k;
+	}
+	return matched;
+}
@@ -13,6 +13,7 @@
 ******************/
 #include <stdint.h>
 
+#include "arbiter.h"
 #include "config.h"
 #include "lcd.h"
 #include "logger.h"
@@ -40,6 +41,8 @@ time_t curtime;
 int8_t curday;
 int8_t curhour;
 int8_t curminute;
+uint32_t lastTick;   // millis() of the last one-second control tick
+uint32_t lastRotate; // millis() of the last LCD shift
 
 /**********************
     Private functions
@@ -170,6 +173,7 @@ void setup() {
 	rls_initEEPROM();
 #endif
 	gen_init();
+	arb_init();
 	tmr_init();
 	rls_init();
 
@@ -181,6 +185,17 @@ void setup() {
 }
 
 void loop() {
+	// Every pass: let the REST server advance its connections a little
+	restserver_handle_request();
+	uint32_t ms = millis();
+	if (ms - lastRotate >= 500) {
+		lastRotate = ms;
+		lcd_rotate();
+	}
+	if (ms - lastTick < 1000) {
+		return;
+	}
+	lastTick = ms;
 	// Every second
 	curtime = rtc_now();
 	// Reset time every hour on the third minute and 30 second
@@ -206,9 +221,10 @@ void loop() {
 			rc = wifi_setRTC();
 			while (rc == -2 && retries < 10) { // wrong response, so try again after 2 sec.
 				delay(2000);
+				retries++;
 				rc = wifi_setRTC();
 			}
-			if (retries != 10) {
+			if (rc != -2) {
 				curtime = rtc_now();
 				curday = rtc_day(curtime);
 				curminute = rtc_minute(curtime);
@@ -216,8 +232,6 @@ void loop() {
 			}
 		}
 	}
-	restserver_handle_request();
-    gen_checkDeviceStates(curtime);
 	// Every minute
     if (next_minute()) {
 	    logline("A minute has passed...");
@@ -245,16 +259,13 @@ void loop() {
 		char ip[16];
 		wifi_getIPaddress(ip); // Will show 0.0.0.0 when no wifi available
 		lcd_displayLine2(ip, "");
-		tmr_check(curtime);
-		rls_checkSprayerRule(curtime);
-		rls_checkTempRules(curtime);
 		gen_increase_time_on();
     }
-    int dly = 500; // must be < 1000 = 1 second
-    int8_t steps = 1000 / dly;
-    for (int8_t i = 0; i < steps; i++) {
-	    lcd_rotate();
-	    delay(dly);
-    }
-	// Every second
+	// Every second, but it only acts on the events of the timers that are due
+	tmr_check(curtime);
+	rls_checkSprayerRule(curtime);
+	// Every second, but it only acts when a threshold or window boundary is crossed
+	rls_checkTempRules(curtime);
+	// Switch the devices as the timers, rules and REST calls above requested
+	arb_tick(curtime);
 }
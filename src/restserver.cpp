@@ -15,6 +15,9 @@
 #include <TimeLib.h>
 #include <WiFiNINA.h>
 #include "restserver.h"
+#include "arbiter.h"
+#include "binder.h"
+#include "journal.h"
 #include "logger.h"
 #include "rtc.h"
 #include "rules.h"
@@ -27,21 +30,876 @@
     Private data
 ******************/
 WiFiServer server(80);
-WiFiClient client;
-char jsonString[1300];
+Connection connections[REST_MAX_CONNECTIONS];
+char jsonString[REST_BODY_SIZE];
+int8_t jsonOwner = -1; // connection that is using jsonString, -1 = free
+jsmn_parser bodyParser;                  // parser of the element being received
+uint16_t bodyFill;                       // nr of body bytes in jsonString
+int8_t bodyState;                        // BODY_START, BODY_ELEMENTS or BODY_DONE
+char elementError[BND_ERROR_SIZE];       // why an element of a streamed body is rejected
+uint32_t bootId = 0;   // ETags of a previous run must not match the restarted version counters
+
+// Writes into jsonString, but never past the part of the CBOR body that is still unread
+class BodyPrint : public Print {
+public:
+	uint16_t len = 0;
+	const uint8_t **unread;
+	size_t write(uint8_t c) {
+		if ((const uint8_t *)jsonString + len >= *unread) {
+			return 0;
+		}
+		jsonString[len++] = c;
+		return 1;
+	}
+};
 
 /**********************
     Private functions
 **********************/
 
-void sendResponse(char *jsonString) {
-	client.println("HTTP/1.1 200 OK");
-	client.println("Content-Type: application/json");
-	client.println("Connection: close");
-	client.print("Content-Length: ");
-	client.println(strlen(jsonString));
-	client.println();
-	client.println(jsonString);
+// Status line and connection headers, the other headers follow
+void sendStatusLine(Connection *conn, int16_t status, char *reason) {
+	WiFiClient *client = &conn->client;
+	client->print("HTTP/1.1 ");
+	client->print(status);
+	client->print(" ");
+	client->println(reason);
+	if (conn->keepalive) {
+		client->println("Connection: keep-alive");
+		client->print("Keep-Alive: timeout=");
+		client->print(REST_IDLE_TIMEOUT / 1000);
+		client->print(", max=");
+		client->println(REST_MAX_REQUESTS - conn->nr_of_requests);
+	} else {
+		client->println("Connection: close");
+	}
+}
+
+// Send the status line and the headers. A JSON body follows in chunks (HTTP/1.1)
+// or, for HTTP/1.0 clients, lasts until the connection is closed.
+void sendHeader(Connection *conn, int16_t status, char *reason, bool json) {
+	WiFiClient *client = &conn->client;
+	if (json && !conn->http11) {
+		conn->keepalive = false;
+	}
+	sendStatusLine(conn, status, reason);
+	if (conn->etag >= 0) {
+		char tag[20];
+		sprintf(tag, "\"%08lx-%06lx\"", (unsigned long)bootId, (unsigned long)conn->etag);
+		client->print("ETag: ");
+		client->println(tag);
+		client->println("Vary: Accept");
+	}
+	if (json) {
+		client->println(conn->cbor ? "Content-Type: application/cbor" : "Content-Type: application/json");
+		if (conn->http11) {
+			client->println("Transfer-Encoding: chunked");
+		}
+	} else if (status != 304) {
+		client->println("Content-Length: 0");
+	}
+	client->println();
+}
+
+// Send a response with a small JSON text that is already in memory
+void sendText(Connection *conn, int16_t status, char *reason, char *json) {
+	WiFiClient *client = &conn->client;
+	sendStatusLine(conn, status, reason);
+	client->println("Content-Type: application/json");
+	client->print("Content-Length: ");
+	client->println(strlen(json));
+	client->println();
+	client->print(json);
+}
+
+// Connection c is done with jsonString
+void releaseBody(int8_t c) {
+	if (jsonOwner == c) {
+		jsonOwner = -1;
+	}
+}
+
+void closeConnection(int8_t c) {
+	connections[c].client.stop();
+	connections[c].state = CONN_FREE;
+	releaseBody(c);
+}
+
+// Version from an If-None-Match header value, only tags of this run count
+int32_t parseIfNoneMatch(const char *value) {
+	char prefix[11];
+	sprintf(prefix, "\"%08lx-", (unsigned long)bootId);
+	const char *tag = strstr(value, prefix);
+	if (tag != NULL) {
+		return strtol(tag + 10, NULL, 16);
+	}
+	while (*value == ' ') {
+		value++;
+	}
+	return (*value == '*' ? -2 : -1);
+}
+
+// Replace the CBOR body in jsonString by its JSON text, so the setters need only one format.
+// The CBOR is moved to the end of the buffer and the JSON is written from the start.
+bool cborToJson(uint16_t len) {
+	if (len >= REST_BODY_SIZE) {
+		return false;
+	}
+	const uint8_t *end = (const uint8_t *)jsonString + REST_BODY_SIZE - 1;
+	const uint8_t *cbor = end - len;
+	memmove((void *)cbor, jsonString, len);
+	BodyPrint out;
+	out.unread = &cbor;
+	JsonWriter jw;
+	jw_init(&jw, &out, false, false);
+	bool ok = jw_fromCbor(&jw, &cbor, end) && cbor == end;
+	jw_end(&jw);
+	ok = ok && out.len == jw.total;
+	jsonString[out.len] = 0;
+	return ok;
+}
+
+// Reads one line into buf, a few bytes at a time.
+// Returns true when the line is complete, excess characters are dropped.
+// With cbor the whole line, the dropped characters too, is searched for the CBOR media type.
+bool readLine(Connection *conn, char *buf, uint8_t *len, uint8_t size, uint8_t *cbor) {
+	for (int8_t n = 0; n < REST_BYTES_PER_PASS && conn->client.available(); n++) {
+		char c = conn->client.read();
+		conn->timestamp = millis();
+		if (c == '\n') {
+			buf[*len] = 0;
+			return true;
+		} else if (c != '\r') {
+			if (*len < size - 1) {
+				buf[(*len)++] = c;
+			}
+			if (cbor != NULL) {
+				*cbor = jw_matchCborType(*cbor, c);
+			}
+		}
+	}
+	return false;
+}
+
+// true if the ?fields=a,b,c query of the request selects field name, no query selects all
+bool rest_field(const char *query, const char *name) {
+	const char *s = (query == NULL ? NULL : strstr(query, "fields="));
+	if (s == NULL) {
+		return true;
+	}
+	s += 7;
+	uint8_t len = strlen(name);
+	while (*s != 0 && *s != '&') {
+		if (strncmp(s, name, len) == 0 && (s[len] == ',' || s[len] == '&' || s[len] == 0)) {
+			return true;
+		}
+		while (*s != 0 && *s != '&' && *s++ != ',') {
+		}
+	}
+	return false;
+}
+
+// Value of number parameter name in the query, def if it is not there
+int32_t rest_queryNumber(const char *query, const char *name, int32_t def) {
+	uint8_t len = strlen(name);
+	for (const char *s = query; s != NULL && *s != 0; s = strchr(s, '&')) {
+		if (*s == '&') {
+			s++;
+		}
+		if (strncmp(s, name, len) == 0 && s[len] == '=') {
+			return strtol(s + len + 1, NULL, 10);
+		}
+	}
+	return def;
+}
+
+// The properties also hold max_expiry_delay, both numbers only grow so their sum changes with either
+uint16_t propertiesVersion() {
+	return gen_getVersion() + arb_getMaxDelay();
+}
+
+/*
+* Route handlers
+*/
+void getProperties(RouteParams *p, JsonWriter *jw) {
+	gen_getProperties(jw);
+}
+
+void getSensors(RouteParams *p, JsonWriter *jw) {
+	sensors_tojson(jw);
+}
+
+void getState(RouteParams *p, JsonWriter *jw) {
+	gen_getDeviceStates(jw);
+}
+
+void getRuleset(RouteParams *p, JsonWriter *jw) {
+	rls_getRuleSetAsJson(p->setnr, jw);
+}
+
+void getSprayerRule(RouteParams *p, JsonWriter *jw) {
+	rls_getSprayerRuleAsJson(jw);
+}
+
+void getTimers(RouteParams *p, JsonWriter *jw) {
+	tmr_getTimersAsJson(p->device, jw);
+}
+
+// All state in one response. It is written in one go, so nothing changes halfway.
+void getSnapshot(RouteParams *p, JsonWriter *jw) {
+	jw_beginObject(jw);
+	jw_long(jw, "time", now());
+	if (rest_field(p->query, "properties")) {
+		jw_key(jw, "properties");
+		gen_getProperties(jw);
+	}
+	if (rest_field(p->query, "sensors")) {
+		jw_key(jw, "sensors");
+		sensors_tojson(jw);
+	}
+	if (rest_field(p->query, "state")) {
+		jw_key(jw, "state");
+		gen_getDeviceStates(jw);
+	}
+	if (rest_field(p->query, "timers")) {
+		jw_key(jw, "timers");
+		jw_beginObject(jw);
+		for (int8_t dev = 0; dev < NR_OF_DEVICES; dev++) {
+			jw_key(jw, gen_getDevices()[dev].name);
+			tmr_getTimersAsJson(dev, jw);
+		}
+		jw_endObject(jw);
+	}
+	if (rest_field(p->query, "rulesets")) {
+		jw_key(jw, "rulesets");
+		jw_beginArray(jw);
+		for (int8_t setnr = 0; setnr < NR_OF_RULESETS; setnr++) {
+			rls_getRuleSetAsJson(setnr, jw);
+		}
+		jw_endArray(jw);
+	}
+	if (rest_field(p->query, "sprayerrule")) {
+		jw_key(jw, "sprayerrule");
+		rls_getSprayerRuleAsJson(jw);
+	}
+	jw_endObject(jw);
+}
+
+void getChanges(RouteParams *p, JsonWriter *jw) {
+	jrn_getChangesAsJson(rest_queryNumber(p->query, "since", 0), jw);
+}
+
+// Switching by hand goes before the timers and rules. In auto mode only until a timer or
+// rule changes its request for the device. The arbiter switches the device on its next tick.
+void putDeviceOn(RouteParams *p, JsonWriter *jw) {
+	arb_request(ARB_MANUAL, p->device, -1);
+}
+
+void putDeviceOnPeriod(RouteParams *p, JsonWriter *jw) {
+	arb_request(ARB_MANUAL, p->device, now() + p->period);
+}
+
+void putDeviceOff(RouteParams *p, JsonWriter *jw) {
+	arb_request(ARB_MANUAL, p->device, 0);
+}
+
+void putDeviceManual(RouteParams *p, JsonWriter *jw) {
+	gen_setDeviceToManual(p->device, true);
+}
+
+void putDeviceAuto(RouteParams *p, JsonWriter *jw) {
+	gen_setDeviceToManual(p->device, false);
+}
+
+void putRuleset(RouteParams *p, JsonWriter *jw) {
+	rls_setRuleSetFromJson(p->setnr, jsonString);
+}
+
+void putSprayerRule(RouteParams *p, JsonWriter *jw) {
+	rls_setSprayerRuleFromJson(jsonString);
+}
+
+// Called for each timer in the body
+void putTimers(RouteParams *p, JsonWriter *jw) {
+	if (!tmr_setTimerFromJson(jsonString, elementError)) {
+		p->error = elementError;
+	}
+}
+
+void postSetDate(RouteParams *p, JsonWriter *jw) {
+	rtc_setTime(p->text);
+}
+
+void postTraceOn(RouteParams *p, JsonWriter *jw) {
+	gen_setTraceOn(true);
+}
+
+void postTraceOff(RouteParams *p, JsonWriter *jw) {
+	gen_setTraceOn(false);
+}
+
+void postCounter(RouteParams *p, JsonWriter *jw) {
+	gen_setCounter(p->device, p->value);
+}
+
+void postTestOff(RouteParams *p, JsonWriter *jw) {
+	sensors_setTestOff();
+}
+
+void postTestValues(RouteParams *p, JsonWriter *jw) {
+	sensors_setTestValues(p->value, p->value2);
+}
+
+/*
+* Route table
+*
+* The key of a route is a hash of its method and the first segment of its path.
+* Routes with the same key must be next to each other, the compiler checks that
+* and that routes with different keys never share a slot of the hash table.
+*/
+constexpr uint16_t rest_hash(const char *s, uint16_t h) {
+	return (*s == 0 || *s == '/' || *s == '?') ? h : rest_hash(s + 1, (uint16_t)(h * REST_ROUTE_HASH + (uint8_t)*s));
+}
+
+// The slot is taken from the 5 highest bits of the key
+#define ROUTE_SLOT(key) ((key) >> 11)
+
+#define ROUTE(method, pattern, flags, handler, version) \
+	{ method, pattern, flags, handler, version, rest_hash(pattern + 1, method) }
+
+constexpr Route routes[] = {
+	ROUTE(GET,  "/properties",                 ROUTE_JSON, getProperties,     propertiesVersion),
+	ROUTE(GET,  "/sensors",                    ROUTE_JSON, getSensors,        NULL),
+	ROUTE(GET,  "/state",                      ROUTE_JSON, getState,          gen_getVersion),
+	ROUTE(GET,  "/ruleset/{setnr}",            ROUTE_JSON, getRuleset,        rls_getVersion),
+	ROUTE(GET,  "/sprayerrule",                ROUTE_JSON, getSprayerRule,    rls_getVersion),
+	ROUTE(GET,  "/timers/{device}",            ROUTE_JSON, getTimers,         tmr_getVersion),
+	ROUTE(GET,  "/snapshot",                   ROUTE_JSON, getSnapshot,       NULL),
+	ROUTE(GET,  "/changes",                    ROUTE_JSON, getChanges,        jrn_getVersion),
+	ROUTE(GET,  "/events",                     ROUTE_EVENTS, NULL,            NULL),
+	ROUTE(PUT,  "/device/{device}/on",         0,          putDeviceOn,       NULL),
+	ROUTE(PUT,  "/device/{device}/on/{period}", 0,         putDeviceOnPeriod, NULL),
+	ROUTE(PUT,  "/device/{device}/off",        0,          putDeviceOff,      NULL),
+	ROUTE(PUT,  "/device/{device}/manual",     0,          putDeviceManual,   NULL),
+	ROUTE(PUT,  "/device/{device}/auto",       0,          putDeviceAuto,     NULL),
+	ROUTE(PUT,  "/ruleset/{setnr}",            ROUTE_BODY, putRuleset,        NULL),
+	ROUTE(PUT,  "/sprayerrule",                ROUTE_BODY, putSprayerRule,    NULL),
+	ROUTE(PUT,  "/timers",                     ROUTE_BODY | ROUTE_STREAM, putTimers, NULL),
+	ROUTE(POST, "/setdate/{datetime}",         0,          postSetDate,       NULL),
+	ROUTE(POST, "/trace/on",                   0,          postTraceOn,       NULL),
+	ROUTE(POST, "/trace/off",                  0,          postTraceOff,      NULL),
+	ROUTE(POST, "/counter/{device}/{value}",   0,          postCounter,       NULL),
+	ROUTE(POST, "/test/off",                   0,          postTestOff,       NULL),
+	ROUTE(POST, "/test/{room}/{terrarium}",    0,          postTestValues,    NULL)
+};
+#define NR_OF_ROUTES (int8_t)(sizeof(routes) / sizeof(routes[0]))
+
+// true if no route after route j has the key of route i but a different slot or position
+constexpr bool rest_checkRoute(int8_t i, int8_t j) {
+	return j >= NR_OF_ROUTES ? true
+		: (routes[j].key != routes[i].key && ROUTE_SLOT(routes[j].key) == ROUTE_SLOT(routes[i].key)) ? false
+		: (routes[j].key == routes[i].key && routes[j - 1].key != routes[i].key) ? false
+		: rest_checkRoute(i, j + 1);
+}
+
+constexpr bool rest_checkRoutes(int8_t i) {
+	return i >= NR_OF_ROUTES ? true : rest_checkRoute(i, i + 1) && rest_checkRoutes(i + 1);
+}
+
+static_assert(rest_checkRoutes(0), "Route table: routes share a hash slot (change REST_ROUTE_HASH) or are not grouped");
+
+// First route in the given slot, -1 = none
+constexpr int8_t rest_slot(uint8_t slot, int8_t i) {
+	return i >= NR_OF_ROUTES ? -1 : (ROUTE_SLOT(routes[i].key) == slot ? i : rest_slot(slot, i + 1));
+}
+
+#define SLOTS4(n) rest_slot(n, 0), rest_slot(n + 1, 0), rest_slot(n + 2, 0), rest_slot(n + 3, 0)
+static_assert(REST_ROUTE_SLOTS == 32, "routeSlots[] must be extended");
+const int8_t routeSlots[REST_ROUTE_SLOTS] = {
+	SLOTS4(0), SLOTS4(4), SLOTS4(8), SLOTS4(12), SLOTS4(16), SLOTS4(20), SLOTS4(24), SLOTS4(28)
+};
+
+// Parse a number from a path segment that is len characters long
+bool rest_number(const char *s, uint8_t len, int32_t min, int32_t max, int32_t *value) {
+	bool neg = (len > 0 && *s == '-');
+	if (neg) {
+		s++;
+		len--;
+	}
+	if (len == 0 || len > 9) {
+		return false;
+	}
+	int32_t v = 0;
+	for (uint8_t i = 0; i < len; i++) {
+		if (s[i] < '0' || s[i] > '9') {
+			return false;
+		}
+		v = v * 10 + (s[i] - '0');
+	}
+	*value = (neg ? -v : v);
+	return *value >= min && *value <= max;
+}
+
+// The value of a Content-Length header, returns the status to answer when it is rejected, else 0
+int16_t rest_contentLength(const char *s, uint16_t *length) {
+	while (*s == ' ') {
+		s++;
+	}
+	uint8_t len = strlen(s);
+	while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\r')) {
+		len--;
+	}
+	int32_t v;
+	if (!rest_number(s, len, 0, INT32_MAX, &v)) {
+		return 400;
+	} else if (v > (int32_t)REST_MAX_CONTENT) {
+		return 413;
+	}
+	*length = v;
+	return 0;
+}
+
+// Convert the path segment of a placeholder into its typed value
+bool rest_param(const char *name, const char *s, uint8_t len, RouteParams *p) {
+	int32_t v;
+	if (strncmp(name, "setnr}", 6) == 0) {
+		if (!rest_number(s, len, 1, NR_OF_RULESETS, &v)) {
+			return false;
+		}
+		p->setnr = v - 1;
+	} else if (strncmp(name, "device}", 7) == 0) {
+		p->device = gen_getDeviceId(s, len);
+		return p->device >= 0;
+	} else if (strncmp(name, "period}", 7) == 0) {
+		return rest_number(s, len, 1, 86400L, &p->period);
+	} else if (strncmp(name, "value}", 6) == 0 || strncmp(name, "room}", 5) == 0) {
+		return rest_number(s, len, -99999999L, 99999999L, &p->value);
+	} else if (strncmp(name, "terrarium}", 10) == 0) {
+		return rest_number(s, len, -99, 99, &p->value2);
+	} else if (strncmp(name, "datetime}", 9) == 0) {
+		p->text = s;
+		return len == 16; // 2020-10-06T15:30
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// Match the path segment by segment with the pattern of a route
+bool rest_match(const char *pattern, const char *path, RouteParams *p) {
+	while (*pattern != 0) {
+		if (*pattern++ != '/' || *path++ != '/') {
+			return false;
+		}
+		uint8_t len = 0;
+		while (path[len] != 0 && path[len] != '/' && path[len] != '?') {
+			len++;
+		}
+		if (*pattern == '{') {
+			if (!rest_param(pattern + 1, path, len, p)) {
+				return false;
+			}
+			while (*pattern != '}') {
+				pattern++;
+			}
+			pattern++;
+		} else {
+			for (uint8_t i = 0; i < len; i++) {
+				if (*pattern++ != path[i]) {
+					return false;
+				}
+			}
+			if (*pattern != 0 && *pattern != '/') {
+				return false;
+			}
+		}
+		path += len;
+	}
+	if (*path == '?') {
+		p->query = path + 1;
+	}
+	return *path == 0 || *path == '?';
+}
+
+// req=[method] [url], returns the index of the route or -1
+int8_t rest_findRoute(char *req, RouteParams *p) {
+	int8_t method;
+	const char *path;
+	if (strncmp(req, "GET /", 5) == 0) {
+		method = GET;
+		path = req + 4;
+	} else if (strncmp(req, "PUT /", 5) == 0) {
+		method = PUT;
+		path = req + 4;
+	} else if (strncmp(req, "POST /", 6) == 0) {
+		method = POST;
+		path = req + 5;
+	} else if (strncmp(req, "DELETE /", 8) == 0) {
+		method = DELETE;
+		path = req + 7;
+	} else {
+		return -1;
+	}
+	uint16_t key = method;
+	for (const char *s = path + 1; *s != 0 && *s != '/' && *s != '?'; s++) {
+		key = key * REST_ROUTE_HASH + (uint8_t)*s;
+	}
+	memset(p, 0, sizeof(RouteParams));
+	for (int8_t r = routeSlots[ROUTE_SLOT(key)]; r != -1 && r < NR_OF_ROUTES && routes[r].key == key; r++) {
+		if (rest_match(routes[r].pattern, path, p)) {
+			return r;
+		}
+	}
+	return -1;
+}
+
+// Hand every complete element of the array in jsonString to the handler of the route.
+// What is left of jsonString is the start of the next element.
+void streamBody(Connection *conn) {
+	uint16_t i = 0;
+	while (conn->body_error == NULL) {
+		if (bodyParser.toknext == 0 && bodyParser.pos == 0) {
+			// between two elements
+			while (i < bodyFill && strchr(" \t\r\n,", jsonString[i]) != NULL) {
+				i++;
+			}
+			if (i == bodyFill) {
+				break;
+			}
+			if (bodyState == BODY_START) {
+				if (jsonString[i] != '[') {
+					conn->body_error = "An array is expected";
+				}
+				bodyState = BODY_ELEMENTS;
+				i++;
+				continue;
+			} else if (bodyState == BODY_DONE) {
+				i = bodyFill; // ignore what follows the array
+				break;
+			} else if (jsonString[i] == ']') {
+				bodyState = BODY_DONE;
+				i++;
+				continue;
+			}
+			// the element starts at the start of the buffer, jsmn keeps offsets
+			memmove(jsonString, jsonString + i, bodyFill - i);
+			bodyFill -= i;
+			i = 0;
+		}
+		// the token arena is only borrowed while jsmn_parse runs, others may need it between passes
+		jsmntok_t *tokens = jsmn_borrow();
+		if (tokens == NULL) {
+			break; // try again in the next pass
+		}
+		jsmnerr_t r = jsmn_parse(&bodyParser, jsonString, bodyFill, tokens, REST_BODY_TOKENS);
+		jsmn_return();
+		if (r == JSMN_ERROR_PART) {
+			if (bodyFill >= REST_BODY_SIZE - 1) {
+				conn->body_error = "An element of the array is too large";
+			}
+			jsmn_init(&bodyParser); // parsed again from its start when more has arrived
+			break;
+		} else if (r != JSMN_SUCCESS) {
+			conn->body_error = "Could not deserialize the JSON";
+			break;
+		}
+		// jsonString[0..pos) is one complete element
+		i = bodyParser.pos;
+		char next = jsonString[i];
+		jsonString[i] = 0;
+		// the handler parses the element again, with the same tokens
+		conn->params.error = NULL;
+		routes[conn->route].handler(&conn->params, NULL);
+		conn->body_error = conn->params.error;
+		jsonString[i] = next;
+		jsmn_init(&bodyParser);
+	}
+	memmove(jsonString, jsonString + i, bodyFill - i);
+	bodyFill -= i;
+}
+
+// Turn the connection into an event stream that is fed from the journal
+void startEvents(Connection *conn) {
+	int8_t subscribers = 0;
+	for (int8_t c = 0; c < REST_MAX_CONNECTIONS; c++) {
+		if (connections[c].state == CONN_EVENTS) {
+			subscribers++;
+		}
+	}
+	conn->keepalive = false;
+	if (subscribers >= REST_MAX_SUBSCRIBERS) {
+		sendHeader(conn, 503, "Service Unavailable", false);
+		return;
+	}
+	sendStatusLine(conn, 200, "OK");
+	conn->client.println("Content-Type: text/event-stream");
+	conn->client.println("Cache-Control: no-cache");
+	conn->client.println();
+	conn->state = CONN_EVENTS;
+	logline("Event stream started");
+}
+
+// Send the events that are new in the journal, a few per pass
+void sendEvents(Connection *conn) {
+	uint32_t seq = jrn_getSeq();
+	Change change;
+	JsonWriter jw;
+	if (conn->event_seq > seq) {
+		conn->event_seq = seq; // the Last-Event-ID of a previous run
+	}
+	for (uint8_t n = 0; conn->event_seq < seq && n < REST_EVENTS_PER_PASS;) {
+		conn->event_seq++;
+		if (!jrn_get(conn->event_seq, &change)) {
+			// the subscriber is too far behind, it has to get the state again
+			conn->client.print("event: resync\ndata: {}\n\n");
+			conn->event_seq = seq;
+			conn->timestamp = millis();
+			break;
+		}
+		if (change.kind != JRN_DEVICE && change.kind != JRN_THRESHOLD && change.kind != JRN_SPRAYER_RUN) {
+			continue;
+		}
+		conn->client.print("id: ");
+		conn->client.print(conn->event_seq);
+		conn->client.print("\ndata: ");
+		jw_init(&jw, &conn->client, false, false);
+		jrn_getChangeAsJson(conn->event_seq, &change, &jw);
+		jw_end(&jw);
+		conn->client.print("\n\n");
+		conn->timestamp = millis();
+		n++;
+	}
+	if (millis() - conn->timestamp > REST_EVENT_PING) {
+		// lets a dead subscriber show up as a broken connection
+		conn->client.print(": ping\n\n");
+		conn->timestamp = millis();
+	}
+}
+
+void dispatch(Connection *conn) {
+	conn->nr_of_requests++;
+	if (conn->nr_of_requests >= REST_MAX_REQUESTS) {
+		conn->keepalive = false;
+	}
+	if (conn->route == -1) {
+		sendHeader(conn, 404, "Not Found", false);
+		return;
+	}
+	const Route *route = &routes[conn->route];
+	JsonWriter jw;
+	if (route->flags & ROUTE_EVENTS) {
+		startEvents(conn);
+		return;
+	}
+	if (conn->body_error != NULL) {
+		sprintf(jsonString, "{\"error_msg\":\"%s\"}", conn->body_error);
+		sendText(conn, 400, "Bad Request", jsonString);
+		return;
+	}
+	if (route->flags & ROUTE_STREAM) {
+		sendHeader(conn, 200, "OK", false); // the handler has seen all elements already
+		return;
+	}
+	if (route->version != NULL) {
+		// unchanged data is not serialized again, the route is part of the tag
+		conn->etag = ((int32_t)conn->route << 16) | route->version();
+		if (conn->cbor) {
+			conn->etag |= 0x800000L; // the CBOR and the JSON variant differ
+		}
+		if (conn->if_none_match == conn->etag || conn->if_none_match == -2) {
+			sendHeader(conn, 304, "Not Modified", false);
+			return;
+		}
+	}
+	if (route->flags & ROUTE_JSON) {
+		// the body is streamed straight to the client
+		sendHeader(conn, 200, "OK", true);
+		jw_init(&jw, &conn->client, conn->http11, conn->cbor);
+		route->handler(&conn->params, &jw);
+		jw_end(&jw);
+		logline("Sent %ld bytes", (long)jw.total);
+	} else {
+		jw_init(&jw, &conn->client, false, false);
+		route->handler(&conn->params, &jw);
+		// the setters leave an error message in jsonString
+		if ((route->flags & ROUTE_BODY) && jsonString[0] != 0) {
+			sendText(conn, 400, "Bad Request", jsonString);
+		} else {
+			sendHeader(conn, 200, "OK", false);
+		}
+	}
+}
+
+// Advance one connection as far as the bytes that have arrived allow.
+void handleConnection(int8_t c) {
+	Connection *conn = &connections[c];
+	if (conn->state != CONN_LINGER && !conn->client.connected()) {
+		closeConnection(c);
+		return;
+	}
+	switch (conn->state) {
+	case CONN_REQUEST_LINE:
+		// req=[method] [url] HTTP/1.1
+		if (readLine(conn, conn->req, &conn->reqlen, REST_REQ_LINE_SIZE, NULL)) {
+			if (conn->reqlen == 0) {
+				break; // stray line end between requests
+			}
+			char *http = strstr(conn->req, " HTTP");
+			if (http == NULL) {
+				// the rest of the stream cannot be trusted anymore
+				conn->keepalive = false;
+				sendHeader(conn, 400, "Bad Request", false);
+				conn->state = CONN_LINGER;
+				conn->timestamp = millis();
+				break;
+			}
+			// req=[method] [url]
+			conn->http11 = (strncmp(http, " HTTP/1.1", 9) == 0);
+			conn->keepalive = conn->http11; // HTTP/1.1 connections are persistent by default
+			*http = 0;
+			logline("Request: %s", conn->req);
+			// an unknown route is answered with 404 after its headers and body are skipped
+			conn->route = rest_findRoute(conn->req, &conn->params);
+			conn->content_length = 0;
+			conn->if_none_match = -1;
+			conn->etag = -1;
+			conn->event_seq = jrn_getSeq();
+			conn->cbor = false;
+			conn->cbor_body = false;
+			conn->body_error = NULL;
+			conn->headerlen = 0;
+			conn->cbormatch = 0;
+			conn->state = CONN_HEADERS;
+		}
+		break;
+	case CONN_HEADERS:
+		// only the headers about the body, the connection, caching and the format are of interest
+		while (readLine(conn, conn->header, &conn->headerlen, REST_HEADER_SIZE, &conn->cbormatch)) {
+			if (conn->headerlen == 0) {
+				conn->bodylen = 0;
+				conn->state = CONN_BODY;
+				break;
+			}
+			if (strncasecmp(conn->header, "Content-Length:", 15) == 0) {
+				int16_t status = rest_contentLength(conn->header + 15, &conn->content_length);
+				if (status != 0) {
+					// where the body ends is not known, so the rest of the stream cannot be trusted
+					conn->keepalive = false;
+					if (status == 413) {
+						sendHeader(conn, 413, "Payload Too Large", false);
+					} else {
+						sendHeader(conn, 400, "Bad Request", false);
+					}
+					conn->state = CONN_LINGER;
+					conn->timestamp = millis();
+					break;
+				}
+			} else if (strncasecmp(conn->header, "If-None-Match:", 14) == 0) {
+				conn->if_none_match = parseIfNoneMatch(conn->header + 14);
+			} else if (strncasecmp(conn->header, "Accept:", 7) == 0) {
+				conn->cbor = (conn->cbormatch == JW_CBOR_MATCHED);
+			} else if (strncasecmp(conn->header, "Content-Type:", 13) == 0) {
+				conn->cbor_body = (conn->cbormatch == JW_CBOR_MATCHED);
+			} else if (strncasecmp(conn->header, "Last-Event-ID:", 14) == 0) {
+				conn->event_seq = strtoul(conn->header + 14, NULL, 10);
+			} else if (strncasecmp(conn->header, "Connection:", 11) == 0) {
+				if (strcasestr(conn->header + 11, "close") != NULL) {
+					conn->keepalive = false;
+				} else if (strcasestr(conn->header + 11, "keep-alive") != NULL) {
+					conn->keepalive = true;
+				}
+			}
+			conn->headerlen = 0;
+			conn->cbormatch = 0;
+		}
+		break;
+	case CONN_BODY: {
+		// only some routes use the body, it is collected in jsonString
+		uint8_t flags = (conn->route == -1 ? 0 : routes[conn->route].flags);
+		if (flags & ROUTE_BODY) {
+			if (jsonOwner != -1 && jsonOwner != c) {
+				break; // wait until the other connection is done with the buffer
+			}
+			if (jsonOwner != c) {
+				jsonOwner = c;
+				bodyFill = 0;
+				bodyState = BODY_START;
+				jsmn_init(&bodyParser);
+			}
+		}
+		// a streamed JSON body is handled while it arrives, CBOR is converted when it is complete
+		bool stream = (jsonOwner == c && (flags & ROUTE_STREAM) && !conn->cbor_body);
+		for (int8_t n = 0; n < REST_BYTES_PER_PASS && conn->bodylen < conn->content_length && conn->client.available(); n++) {
+			if (stream && conn->body_error == NULL && bodyFill >= REST_BODY_SIZE - 1) {
+				break; // first make room
+			}
+			char ch = conn->client.read();
+			if (jsonOwner == c && conn->body_error == NULL) {
+				if (bodyFill < REST_BODY_SIZE - 1) {
+					jsonString[bodyFill++] = ch;
+				} else {
+					conn->body_error = "The body is too large";
+				}
+			}
+			conn->bodylen++;
+			conn->timestamp = millis();
+		}
+		if (stream) {
+			streamBody(conn);
+		}
+		if (conn->bodylen == conn->content_length) {
+			if (jsonOwner == c && conn->body_error == NULL) {
+				if (conn->cbor_body) {
+					if (!cborToJson(bodyFill)) {
+						conn->body_error = "Could not decode the CBOR";
+					}
+					bodyFill = strlen(jsonString);
+					if (flags & ROUTE_STREAM) {
+						streamBody(conn);
+					}
+				}
+				jsonString[bodyFill] = 0;
+				if ((flags & ROUTE_STREAM) && conn->body_error == NULL && bodyState != BODY_DONE) {
+					conn->body_error = "The array is not complete";
+				}
+			}
+			conn->state = CONN_DISPATCH;
+		}
+		break;
+	}
+	case CONN_DISPATCH:
+		dispatch(conn);
+		releaseBody(c);
+		// a pipelined request may already be waiting in the socket
+		if (conn->state != CONN_EVENTS) {
+			conn->state = (conn->keepalive ? CONN_REQUEST_LINE : CONN_LINGER);
+		}
+		conn->reqlen = 0;
+		conn->timestamp = millis();
+		break;
+	case CONN_EVENTS:
+		// the stream lasts until the client closes it, anything it sends is dropped
+		for (int8_t n = 0; n < REST_BYTES_PER_PASS && conn->client.available(); n++) {
+			conn->client.read();
+		}
+		sendEvents(conn);
+		return;
+	case CONN_LINGER:
+		// give the client the time to read the response and close first
+		if (!conn->client.connected() || millis() - conn->timestamp > REST_LINGER_TIME) {
+			closeConnection(c);
+		}
+		return;
+	}
+	if (conn->state == CONN_REQUEST_LINE && conn->reqlen == 0 && conn->nr_of_requests > 0) {
+		// idle between two requests
+		if (millis() - conn->timestamp > REST_IDLE_TIMEOUT) {
+			closeConnection(c);
+		}
+	} else if (conn->state != CONN_FREE && millis() - conn->timestamp > REST_READ_TIMEOUT) {
+		logline("Request timed out");
+		closeConnection(c);
+	}
 }
 
 /*****************************************************************
@@ -59,85 +917,50 @@ bool restserver_init() {
 		logline("Cannot start REST server: no local network connection.");
 		return false;
 	}
+	if (bootId == 0) {
+		bootId = rtc_now();
+	}
 	logline("REST server started.");
 	return true;
 }
 
 void restserver_handle_request() {
 	if (server.status() == LISTEN) {
-		// listen for incoming clients
-		client = server.available();
+		// accept a new client if there is a free slot for it
+		WiFiClient client = server.available();
 		if (client) {
-			// an http request line ends with a blank line
-			// read the request line
-			char req[50] = {0};
-			client.readBytesUntil('\r', req, 50);
-			// req=[method] [url] HTTP 1.1 ....
-			*strstr(req, " HTTP") = 0;
-			// req=[method] [url]
-			logline("Request: %s", req);
-			if (strcmp(req, "GET /properties") == 0) {
-				gen_getProperties(jsonString);
-			} else if (strcmp(req, "GET /sensors") == 0) {
-				sensors_tojson(jsonString);
-			} else if (strcmp(req, "GET /state") == 0) {
-				gen_getDeviceStates(jsonString);
-			} else if (strncmp(req, "PUT /device", 11) == 0) {
-				gen_setDeviceState(req + 12);
-				jsonString[0] = 0;
-			} else if (strncmp(req, "GET /ruleset", 12) == 0) {
-				rls_getRuleSetAsJson(atoi(req + 13) - 1, jsonString);
-			} else if (strncmp(req, "PUT /ruleset", 12) == 0) {
-				client.find("\r\n\r\n");
-				int sz = client.readBytes(jsonString, 1300);
-				jsonString[sz] = '\0';
-				Serial1.println(jsonString);
-				rls_setRuleSetFromJson(atoi(req + 13) - 1, jsonString);
-			} else if (strncmp(req, "GET /sprayerrule", 16) == 0) {
-				rls_getSprayerRuleAsJson(jsonString);
-			} else if (strncmp(req, "PUT /sprayerrule", 16) == 0) {
-				client.find("\r\n\r\n");
-				int sz = client.readBytes(jsonString, 1300);
-				jsonString[sz] = '\0';
-				Serial1.println(jsonString);
-				rls_setSprayerRuleFromJson(jsonString);
-			} else if (strncmp(req, "GET /timers", 11) == 0) {
-				tmr_getTimersAsJson(req + 12, jsonString);
-			} else if (strncmp(req, "PUT /timers", 11) == 0) {
-				client.find("\r\n\r\n");
-				int sz = client.readBytes(jsonString, 1300);
-				jsonString[sz] = '\0';
-				Serial1.println(jsonString);
-				tmr_setTimersFromJson(jsonString);
-			} else if (strncmp(req, "POST /setdate", 13) == 0) {
-				rtc_setTime(req + 14);
-				jsonString[0] = 0;
-			} else if (strncmp(req, "POST /trace/on", 14) == 0) {
-				gen_setTraceOn(true);
-				jsonString[0] = 0;
-			} else if (strncmp(req, "POST /trace/off", 15) == 0) {
-				gen_setTraceOn(false);
-			} else if (strncmp(req, "POST /counter", 13) == 0) {
-				gen_setCounter(req + 14);
-				jsonString[0] = 0;
-			} else if (strcmp(req, "POST /test/off") == 0) {
-				sensors_setTestOff();
-				jsonString[0] = 0;
-			} else if (strncmp(req, "POST /test", 10) == 0) {
-				sensors_setTestValues(req + 11);
-				jsonString[0] = 0;
-			}
-			// create the response
-			if (client.connected()) {
-				sendResponse(jsonString);
-				if (strlen(jsonString) > 0) {
-					logline("Sent %d bytes:", strlen(jsonString));
-					Serial1.println(jsonString);
+			int8_t free = -1;
+			int8_t idle = -1;
+			bool known = false;
+			for (int8_t c = 0; c < REST_MAX_CONNECTIONS; c++) {
+				Connection *conn = &connections[c];
+				if (conn->state == CONN_FREE) {
+					free = (free == -1 ? c : free);
+				} else if (conn->client == client) {
+					known = true;
+				} else if (conn->state == CONN_REQUEST_LINE && conn->reqlen == 0 && conn->nr_of_requests > 0) {
+					if (idle == -1 || conn->timestamp < connections[idle].timestamp) {
+						idle = c;
+					}
 				}
 			}
-			delay(2000);
-			// close the connection:
-			client.stop();
+			if (!known && free == -1 && idle != -1) {
+				// all slots are taken: make room by closing the longest idle keep-alive connection
+				closeConnection(idle);
+				free = idle;
+			}
+			if (!known && free != -1) {
+				connections[free].client = client;
+				connections[free].state = CONN_REQUEST_LINE;
+				connections[free].reqlen = 0;
+				connections[free].nr_of_requests = 0;
+				connections[free].timestamp = millis();
+			}
+		}
+	}
+	for (int8_t c = 0; c < REST_MAX_CONNECTIONS; c++) {
+		if (connections[c].state != CONN_FREE) {
+			handleConnection(c);
 		}
 	}
 }
@@ -52,7 +52,7 @@ int8_t rtc_hour(time_t tm) {
 	return hour(tm);
 }
 int8_t rtc_minute(time_t tm) {
-	return minute();
+	return minute(tm);
 }
 int8_t rtc_second(time_t tm) {
 	return second(tm);
@@ -60,7 +60,7 @@ int8_t rtc_second(time_t tm) {
 void rtc_setTime(time_t tm) {
     setTime(tm);
 }
-void rtc_setTime(char *dt) {
+void rtc_setTime(const char *dt) {
 	char tmp[5];
 	tmElements_t tmel;
 	strncpy(tmp, dt, 4);
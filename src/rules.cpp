@@ -13,10 +13,13 @@
     Includes
 ******************/
 #ifndef SIMULATION
-#include <JsonParser.h>
 #include <TimeLib.h>
 #endif
+#include <string.h>
+#include "arbiter.h"
+#include "binder.h"
 #include "eeprom.h"
+#include "journal.h"
 #include "logger.h"
 #include "rules.h"
 #include "sensors.h"
@@ -26,40 +29,568 @@
     Private data
 ******************/
 
-static RuleSet rulesets[] = {
-    {0, false, 0, 0, 0, {{0, {{-1, 0}, {-1, 0}, {-1, 0}, {-1, 0}}}, {0, {{-1, 0}, {-1, 0}, {-1, 0}, {-1, 0}}}}},
-    {1, false, 0, 0, 0, {{0, {{-1, 0}, {-1, 0}, {-1, 0}, {-1, 0}}}, {0, {{-1, 0}, {-1, 0}, {-1, 0}, {-1, 0}}}}}
-};
+// The rulesets one after the other, each starts with its size in bytes. A set
+// that is not used is only that size byte (1), a used set is a StoredRuleSet
+// followed by its rules, each a StoredRule followed by the parameters of its
+// kind and its actions.
+#define RLS_STORE_SIZE EPR_RULESETS_SIZE
+#define RLS_EMPTY      1
+
+typedef struct __attribute__((packed)) { // 8 bytes
+	uint8_t size;           // of the set, its rules included
+	int8_t terrarium_nr;
+	bool active;
+	int16_t from;
+	int16_t to;
+	int8_t temp_ideal;
+} StoredRuleSet;
+
+typedef struct __attribute__((packed)) { // 2 bytes + the parameters + 3 per action
+	int8_t value;
+	uint8_t kind : 4;
+	uint8_t nr_of_actions : 4;
+} StoredRule;
+
+// Nr of parameters after a StoredRule per kind: -, band, minutes, kp ki kd, and
+// for an expression its length byte and then its bytecode
+const uint8_t kindParams[RLS_NR_OF_KINDS] = {0, 1, 1, 3, 1};
+const char *const kindNames[RLS_NR_OF_KINDS] = {"threshold", "hysteresis", "rate", "pid", "expr"};
+
+typedef struct __attribute__((packed)) { // 3 bytes
+	int8_t device;
+	int16_t on_period;
+} StoredAction;
+
+static_assert(NR_OF_RULESETS <= 8, "a ruleset is a bit in a uint8_t");
+static_assert(NR_OF_RULESETS - 1 + sizeof(StoredRuleSet) + RLS_MAX_RULES * (sizeof(StoredRule) + 3 + RLS_MAX_ACTIONS * sizeof(StoredAction)) <= RLS_STORE_SIZE,
+	"The EEPROM for the rulesets cannot hold a ruleset with RLS_MAX_RULES rules");
+static_assert(NR_OF_RULESETS - 1 + sizeof(StoredRuleSet) + sizeof(StoredRule) + 1 + XPR_MAX_CODE + RLS_MAX_ACTIONS * sizeof(StoredAction) <= RLS_STORE_SIZE,
+	"The EEPROM for the rulesets cannot hold an expr rule of XPR_MAX_CODE bytes");
+
+static uint8_t rulesets[RLS_STORE_SIZE];
 static SprayerRule sprayerRule = {0, {{-1, 0}, {-1, 0}, {-1, 0}, {-1, 0}}};
 
 bool sprayerRuleActive = false;
 bool sprayerActionsExecuted = false;
+bool sprayerWasOn = false; // the sprayer rule starts when the sprayer goes off
 time_t startTime, stopTime;
 int16_t max_period = 0;
-bool rulesetActive[2];
-bool rulesetWasActive[2];
+bool rulesetsOff = false;   // switched off while the sprayer rule runs
+bool rulesetWasActive[NR_OF_RULESETS];
+uint8_t thresholdCrossed[NR_OF_RULESETS]; // bit n set: the temperature is beyond the value of rule n
+// The PID loop of the pid rule of each ruleset, it takes a step every RLS_PID_WINDOW seconds
+static struct {
+	int16_t integral;       // sum of the errors of the windows, in degrees
+	int8_t error;           // of the last window
+} pid[NR_OF_RULESETS];
+time_t pidWindow = 0;       // start of the next window
+#define RLS_PID_WINDUP  100 // max of the integral either way
+// The terrarium temperature of the last minutes for the rate rules, [0] is now
+int8_t history[RLS_RATE_MINUTES + 1];
+int16_t historyMinute = -1;
+// What the temperature rules were last evaluated for, they only need to be
+// evaluated again when one of these changes
+static struct {
+	bool valid;
+	uint16_t rules;         // rls_version
+	uint16_t devices;       // arb_getVersion()
+	uint8_t windows;        // bit n set: ruleset n is active and inside its from-to window
+	int8_t low;             // no rule changes its outcome while low <= temp <= high
+	int8_t high;
+	bool rates;             // a rate rule is in the windows, it is evaluated every minute
+	bool pids;              // a pid rule is in the windows, it is evaluated every PID window
+	bool exprs;             // an expr rule is in the windows, it is evaluated every minute and on new sensor values
+	int16_t minute;
+	uint16_t sensors;       // sensors_getVersion()
+} evaluated;
+
+// The JSON of the rules, see the examples at the setters
+const Field actionFields[] = {
+	BND_FIELD(Action, "device",    device,    BND_DEVICE, 0,  0),
+	BND_FIELD(Action, "on_period", on_period, BND_INT16,  -2, 3600)
+};
+const Schema actionSchema = BND_SCHEMA(actionFields);
+
+const Field ruleFields[] = {
+	BND_FIELD(Rule,    "value",   value,   BND_INT8, -50, 50),
+	BND_ENUM_OF(Rule,  "kind",    kind,    kindNames),
+	BND_FIELD(Rule,    "band",    band,    BND_INT8, 1, 20),
+	BND_FIELD(Rule,    "minutes", minutes, BND_INT8, 1, RLS_RATE_MINUTES),
+	BND_FIELD(Rule,    "kp",      kp,      BND_INT8, 0, 100),
+	BND_FIELD(Rule,    "ki",      ki,      BND_INT8, 0, 100),
+	BND_FIELD(Rule,    "kd",      kd,      BND_INT8, 0, 100),
+	BND_FIELD(Rule,    "expr",    expr,    BND_EXPR, 0, 0),
+	BND_ARRAY_OF(Rule, "actions", actions, actionSchema)
+};
+const Schema ruleSchema = BND_SCHEMA(ruleFields);
+const uint8_t kindFirstField[RLS_NR_OF_KINDS] = {0, 2, 3, 4, 0}; // the field in ruleFields of the first parameter
+
+const Field ruleSetFields[] = {
+	BND_FIELD(RuleSet,    "terrarium",  terrarium_nr, BND_INT8,  0, 9),
+	BND_FIELD(RuleSet,    "active",     active,       BND_YESNO, 0, 0),
+	BND_FIELD(RuleSet,    "from",       from,         BND_TIME,  0, 1439),
+	BND_FIELD(RuleSet,    "to",         to,           BND_TIME,  0, 1439),
+	BND_FIELD(RuleSet,    "temp_ideal", temp_ideal,   BND_INT8,  0, 50),
+	BND_ARRAY_OF(RuleSet, "rules",      rules,        ruleSchema)
+};
+const Schema ruleSetSchema = BND_SCHEMA(ruleSetFields);
+
+const Field sprayerRuleFields[] = {
+	BND_FIELD(SprayerRule,    "delay",   delay,   BND_INT8, 0, 120),
+	BND_ARRAY_OF(SprayerRule, "actions", actions, actionSchema)
+};
+const Schema sprayerRuleSchema = BND_SCHEMA(sprayerRuleFields);
+uint16_t rls_version = 0; // increased on every change of the rulesets or the sprayer rule
 
 /**********************
     Private functions
 **********************/
+// The stored ruleset, NULL if the set is not used
+StoredRuleSet *rls_ruleset(int8_t setnr) {
+	uint8_t *p = rulesets;
+	for (int8_t i = 0; i < setnr; i++) {
+		p += *p;
+	}
+	return *p == RLS_EMPTY ? NULL : (StoredRuleSet *)p;
+}
+
+StoredRule *rls_firstRule(StoredRuleSet *rlst) {
+	return (StoredRule *)(rlst + 1);
+}
+
+int8_t *rls_params(StoredRule *rl) {
+	return (int8_t *)(rl + 1);
+}
+
+uint8_t rls_nrOfParams(StoredRule *rl) {
+	return kindParams[rl->kind] + (rl->kind == RLS_EXPR ? (uint8_t)rls_params(rl)[0] : 0);
+}
+
+StoredAction *rls_actions(StoredRule *rl) {
+	return (StoredAction *)(rls_params(rl) + rls_nrOfParams(rl));
+}
+
+StoredRule *rls_nextRule(StoredRule *rl) {
+	return (StoredRule *)(rls_actions(rl) + rl->nr_of_actions);
+}
+
+// The rules of a set run up to the start of the next set
+bool rls_isRule(StoredRuleSet *rlst, StoredRule *rl) {
+	return (uint8_t *)rl < (uint8_t *)rlst + rlst->size;
+}
+
+// Check that the sizes and the rules of all sets lead exactly to the end of
+// the used bytes, that the parameters are in range and that the devices exist
+bool rls_isValid(uint8_t *store) {
+	uint8_t *p = store;
+	for (int8_t i = 0; i < NR_OF_RULESETS; i++) {
+		// each set after this one takes at least 1 byte
+		uint8_t room = store + RLS_STORE_SIZE - (NR_OF_RULESETS - 1 - i) - p;
+		if (*p == 0 || *p > room || (*p > RLS_EMPTY && *p < sizeof(StoredRuleSet))) {
+			return false;
+		}
+		if (*p > RLS_EMPTY) {
+			StoredRuleSet *rlst = (StoredRuleSet *)p;
+			StoredRule *rl = rls_firstRule(rlst);
+			for (int8_t r = 0; rls_isRule(rlst, rl); r++) {
+				if (r == RLS_MAX_RULES || (uint8_t *)(rl + 1) > p + *p || rl->kind >= RLS_NR_OF_KINDS
+						|| (rl->kind == RLS_EXPR && (uint8_t *)(rl + 1) == p + *p)
+						|| (uint8_t *)rls_actions(rl) > p + *p || rl->nr_of_actions > RLS_MAX_ACTIONS
+						|| rl->nr_of_actions > (p + *p - (uint8_t *)rls_actions(rl)) / sizeof(StoredAction)) {
+					return false;
+				}
+				if (rl->kind == RLS_EXPR && !xpr_isValid((uint8_t *)rls_params(rl) + 1, rls_params(rl)[0])) {
+					return false;
+				}
+				for (uint8_t k = 0; rl->kind != RLS_EXPR && k < kindParams[rl->kind]; k++) {
+					const Field *f = &ruleFields[kindFirstField[rl->kind] + k];
+					if (rls_params(rl)[k] < f->min || rls_params(rl)[k] > f->max) {
+						return false; // as the binder accepts them, a rate rule indexes the history with it
+					}
+				}
+				for (uint8_t a = 0; a < rl->nr_of_actions; a++) {
+					if (rls_actions(rl)[a].device < 0 || rls_actions(rl)[a].device >= NR_OF_DEVICES) {
+						return false;
+					}
+				}
+				rl = rls_nextRule(rl);
+			}
+			if ((uint8_t *)rl != p + *p) {
+				return false;
+			}
+		}
+		p += *p;
+	}
+	return true;
+}
+
+void rls_clear() {
+	memset(rulesets, 0, sizeof(rulesets));
+	for (int8_t i = 0; i < NR_OF_RULESETS; i++) {
+		rulesets[i] = RLS_EMPTY;
+	}
+}
+
+// Copy a stored set into the JSON form, the rules and actions it does not use are empty
+void rls_unpack(int8_t setnr, RuleSet *ruleset) {
+	memset(ruleset, 0, sizeof(RuleSet));
+	for (int8_t r = 0; r < RLS_MAX_RULES; r++) {
+		for (int8_t a = 0; a < RLS_MAX_ACTIONS; a++) {
+			ruleset->rules[r].actions[a].device = NO_DEVICE;
+		}
+	}
+	StoredRuleSet *rlst = rls_ruleset(setnr);
+	if (rlst == NULL) {
+		return;
+	}
+	ruleset->terrarium_nr = rlst->terrarium_nr;
+	ruleset->active = rlst->active;
+	ruleset->from = rlst->from;
+	ruleset->to = rlst->to;
+	ruleset->temp_ideal = rlst->temp_ideal;
+	int8_t r = 0;
+	for (StoredRule *rl = rls_firstRule(rlst); rls_isRule(rlst, rl); rl = rls_nextRule(rl), r++) {
+		Rule *rule = &ruleset->rules[r];
+		rule->value = rl->value;
+		rule->kind = rl->kind;
+		int8_t *params = rls_params(rl);
+		if (rl->kind == RLS_HYSTERESIS) {
+			rule->band = params[0];
+		} else if (rl->kind == RLS_RATE) {
+			rule->minutes = params[0];
+		} else if (rl->kind == RLS_PID) {
+			rule->kp = params[0];
+			rule->ki = params[1];
+			rule->kd = params[2];
+		} else if (rl->kind == RLS_EXPR) {
+			memcpy(rule->expr, params, rls_nrOfParams(rl));
+		}
+		for (uint8_t a = 0; a < rl->nr_of_actions; a++) {
+			ruleset->rules[r].actions[a].device = rls_actions(rl)[a].device;
+			ruleset->rules[r].actions[a].on_period = rls_actions(rl)[a].on_period;
+		}
+	}
+}
+
+// true if the rule does something: it has a value or, as an expr rule, an expression
+bool rls_isUsed(Rule *rule) {
+	return rule->kind == RLS_EXPR ? rule->expr[0] != 0 : rule->value != 0;
+}
+
+// Store the set in place of set setnr, rules that are not used and actions without a
+// device are left out. Returns false if it does not fit.
+bool rls_pack(int8_t setnr, RuleSet *ruleset) {
+	uint8_t packed[RLS_STORE_SIZE];
+	StoredRuleSet *rlst = (StoredRuleSet *)packed;
+	rlst->terrarium_nr = ruleset->terrarium_nr;
+	rlst->active = ruleset->active;
+	rlst->from = ruleset->from;
+	rlst->to = ruleset->to;
+	rlst->temp_ideal = ruleset->temp_ideal;
+	StoredRule *rl = rls_firstRule(rlst);
+	for (int8_t r = 0; r < RLS_MAX_RULES; r++) {
+		if (!rls_isUsed(&ruleset->rules[r])) {
+			continue;
+		}
+		Rule *rule = &ruleset->rules[r];
+		// an expr rule may not fit with the others
+		uint8_t size = sizeof(StoredRule) + (rule->kind == RLS_EXPR ? 1 + rule->expr[0] : kindParams[rule->kind]);
+		for (int8_t a = 0; a < RLS_MAX_ACTIONS; a++) {
+			size += (rule->actions[a].device != NO_DEVICE ? sizeof(StoredAction) : 0);
+		}
+		if ((uint8_t *)rl + size > packed + RLS_STORE_SIZE) {
+			return false;
+		}
+		rl->value = rule->value;
+		rl->kind = rule->kind;
+		rl->nr_of_actions = 0;
+		int8_t *params = rls_params(rl);
+		if (rule->kind == RLS_HYSTERESIS) {
+			params[0] = rule->band;
+		} else if (rule->kind == RLS_RATE) {
+			params[0] = rule->minutes;
+		} else if (rule->kind == RLS_PID) {
+			params[0] = rule->kp;
+			params[1] = rule->ki;
+			params[2] = rule->kd;
+		} else if (rule->kind == RLS_EXPR) {
+			memcpy(params, rule->expr, 1 + rule->expr[0]);
+		}
+		for (int8_t a = 0; a < RLS_MAX_ACTIONS; a++) {
+			Action *action = &ruleset->rules[r].actions[a];
+			if (action->device != NO_DEVICE) {
+				rls_actions(rl)[rl->nr_of_actions].device = action->device;
+				rls_actions(rl)[rl->nr_of_actions].on_period = action->on_period;
+				rl->nr_of_actions++;
+			}
+		}
+		rl = rls_nextRule(rl);
+	}
+	rlst->size = (uint8_t *)rl - packed;
+	// Move the sets after this one to make room or to close the gap
+	uint8_t *p = rulesets;
+	for (int8_t i = 0; i < setnr; i++) {
+		p += *p;
+	}
+	uint8_t *next = p + *p;
+	uint8_t *end = next;
+	for (int8_t i = setnr + 1; i < NR_OF_RULESETS; i++) {
+		end += *end;
+	}
+	if (end - next + rlst->size > rulesets + RLS_STORE_SIZE - p) {
+		return false;
+	}
+	memmove(p + rlst->size, next, end - next);
+	memcpy(p, packed, rlst->size);
+	memset(p + rlst->size + (end - next), 0, rulesets + RLS_STORE_SIZE - (p + rlst->size + (end - next)));
+	return true;
+}
+
+// Journal the moments the temperature goes beyond the value of a rule and back
+void rls_checkThreshold(int8_t rs, int8_t r, int8_t value) {
+	int8_t temp = sensors_getTerrariumTemp();
+	bool crossed = (value < 0 && temp < -value) || (value > 0 && temp > value);
+	if (crossed != ((thresholdCrossed[rs] >> r) & 1)) {
+		thresholdCrossed[rs] ^= 1 << r;
+		jrn_add(JRN_THRESHOLD, rs * RLS_MAX_RULES + r, crossed);
+	}
+}
+
+// Bit n is set when ruleset n is active and curmins is inside its window
+uint8_t rls_windows(int16_t curmins) {
+	uint8_t windows = 0;
+	for (int8_t rs = 0; rs < NR_OF_RULESETS; rs++) {
+		StoredRuleSet *rlst = rls_ruleset(rs);
+		if (rlst == NULL || !rlst->active || rulesetsOff) {
+			continue;
+		}
+		bool inside;
+		if (rlst->from > rlst->to) { // period is passing 00:00
+			inside = curmins >= rlst->from || curmins < rlst->to;
+		} else {
+			inside = rlst->from <= curmins && rlst->to > curmins;
+		}
+		if (inside) {
+			windows |= 1 << rs;
+		}
+	}
+	return windows;
+}
+
+// The lowest temperatures at which a rule gives another outcome than just below
+// it. Returns false for the kinds that do not depend on the temperature alone.
+bool rls_boundaries(StoredRuleSet *rlst, StoredRule *rl, int8_t *boundary) {
+	int8_t band = (rl->kind == RLS_HYSTERESIS ? rls_params(rl)[0] : 0);
+	if (rl->kind == RLS_THRESHOLD && rl->value < 0) { // on below -value, off from temp_ideal
+		boundary[0] = -rl->value;
+		boundary[1] = rlst->temp_ideal;
+	} else if (rl->kind == RLS_THRESHOLD) { // off up to temp_ideal, on above value
+		boundary[0] = rlst->temp_ideal + 1;
+		boundary[1] = rl->value + 1;
+	} else if (rl->kind == RLS_HYSTERESIS && rl->value < 0) { // on below -value, off from -value + band
+		boundary[0] = -rl->value;
+		boundary[1] = -rl->value + band;
+	} else if (rl->kind == RLS_HYSTERESIS) { // off up to value - band, on above value
+		boundary[0] = rl->value - band + 1;
+		boundary[1] = rl->value + 1;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// Narrow [low, high] around temp to the range in which no rule of the active windows
+// changes, and note the rules that need to be evaluated on time
+void rls_quietRange(uint8_t windows, int8_t temp) {
+	evaluated.low = INT8_MIN;
+	evaluated.high = INT8_MAX;
+	evaluated.rates = false;
+	evaluated.pids = false;
+	evaluated.exprs = false;
+	for (int8_t rs = 0; rs < NR_OF_RULESETS; rs++) {
+		if (!(windows & (1 << rs))) {
+			continue;
+		}
+		StoredRuleSet *rlst = rls_ruleset(rs);
+		for (StoredRule *rl = rls_firstRule(rlst); rls_isRule(rlst, rl); rl = rls_nextRule(rl)) {
+			int8_t boundary[2];
+			evaluated.rates |= rl->kind == RLS_RATE;
+			evaluated.pids |= rl->kind == RLS_PID;
+			evaluated.exprs |= rl->kind == RLS_EXPR;
+			if (!rls_boundaries(rlst, rl, boundary)) {
+				continue;
+			}
+			for (int b = 0; b < 2; b++) {
+				if (temp < boundary[b] && boundary[b] - 1 < evaluated.high) {
+					evaluated.high = boundary[b] - 1;
+				} else if (temp >= boundary[b] && boundary[b] > evaluated.low) {
+					evaluated.low = boundary[b];
+				}
+			}
+		}
+	}
+}
+
+// Request the devices of the rule on, or with curtime 0 off, the arbiter decides
+void rls_performActions(StoredRule *rl, int32_t curtime) {
+	StoredAction *actions = rls_actions(rl);
+	for (uint8_t a = 0; a < rl->nr_of_actions; a++) {
+		int8_t device = actions[a].device;
+		if (actions[a].on_period != 0) { // so -2 (untill ideal value is reached) or >0. -1 (no endtime) is reserved for timers)
+			if (curtime == 0) { // switch off, a period runs out by itself
+				if (arb_getRequest(ARB_RULE, device) == -2) {
+					arb_release(ARB_RULE, device);
+				}
+			} else if (!arb_hasRequest(ARB_RULE, device)) { // switch on, if not requested already
+				int16_t period = actions[a].on_period;
+				arb_request(ARB_RULE, device, period > 0 ? curtime + period : period);
+			}
+		}
+	}
+}
+
+// Switch off what the rules of the set keep on until the ideal value
+void rls_undoRules(StoredRuleSet *rlst) {
+	for (StoredRule *rl = rls_firstRule(rlst); rls_isRule(rlst, rl); rl = rls_nextRule(rl)) {
+		rls_performActions(rl, 0);
+	}
+}
+
+// One step of the PID loop: switch the devices on for the part of the coming window that it gives
+void rls_pid(int8_t rs, StoredRule *rl, int8_t temp, int32_t curtime) {
+	int8_t *k = rls_params(rl);
+	int8_t error = (rl->value > 0 ? temp - rl->value : -rl->value - temp); // > 0: too warm to cool, too cold to heat
+	int16_t integral = pid[rs].integral + error;
+	pid[rs].integral = (integral > RLS_PID_WINDUP ? RLS_PID_WINDUP : (integral < -RLS_PID_WINDUP ? -RLS_PID_WINDUP : integral));
+	int32_t duty = (int32_t)k[0] * error + (int32_t)k[1] * pid[rs].integral + (int32_t)k[2] * (error - pid[rs].error);
+	duty = (duty < 0 ? 0 : (duty > 100 ? 100 : duty));
+	pid[rs].error = error;
+	logline("  PID of set %d: error=%d on=%d%%", rs + 1, error, (int)duty);
+	if (duty == 0) {
+		return; // what it switched on in the last window goes off by itself
+	}
+	StoredAction *actions = rls_actions(rl);
+	for (uint8_t a = 0; a < rl->nr_of_actions; a++) {
+		// leave the devices alone that another rule keeps on until the ideal value
+		if (arb_getRequest(ARB_RULE, actions[a].device) >= 0) {
+			arb_request(ARB_RULE, actions[a].device, curtime + duty * RLS_PID_WINDOW / 100);
+		}
+	}
+}
+
+void rls_applyRule(int8_t rs, StoredRuleSet *rlst, StoredRule *rl, int8_t temp, int32_t curtime, bool pidStep) {
+	int8_t param = (kindParams[rl->kind] > 0 ? rls_params(rl)[0] : 0); // a threshold rule has no parameters
+	int8_t change;
+	switch (rl->kind) {
+	case RLS_THRESHOLD:
+		if (rl->value < 0 && temp < -rl->value) {
+			rls_performActions(rl, curtime);
+		} else if (rl->value < 0 && temp >= rlst->temp_ideal) {
+			rls_performActions(rl, 0); // reset actions
+		} else if (rl->value > 0 && temp > rl->value) {
+			rls_performActions(rl, curtime);
+		} else if (rl->value > 0 && temp <= rlst->temp_ideal) {
+			rls_performActions(rl, 0); // reset actions
+		}
+		break;
+	case RLS_HYSTERESIS: // param is the band
+		if (rl->value < 0 && temp < -rl->value) {
+			rls_performActions(rl, curtime);
+		} else if (rl->value < 0 && temp >= -rl->value + param) {
+			rls_performActions(rl, 0);
+		} else if (rl->value > 0 && temp > rl->value) {
+			rls_performActions(rl, curtime);
+		} else if (rl->value > 0 && temp <= rl->value - param) {
+			rls_performActions(rl, 0);
+		}
+		break;
+	case RLS_RATE: // param is the nr of minutes, off when the temperature stops rising or falling
+		change = history[0] - history[param];
+		if ((rl->value > 0 && change >= rl->value) || (rl->value < 0 && change <= rl->value)) {
+			rls_performActions(rl, curtime);
+		} else if ((rl->value > 0 && change <= 0) || (rl->value < 0 && change >= 0)) {
+			rls_performActions(rl, 0);
+		}
+		break;
+	case RLS_PID:
+		if (pidStep) {
+			rls_pid(rs, rl, temp, curtime);
+		}
+		break;
+	case RLS_EXPR: { // param is the length of the bytecode, on while it gives non-zero
+		int16_t vars[XPR_NR_OF_VARS];
+		vars[XPR_TERRARIUM_TEMP] = temp;
+		vars[XPR_ROOM_TEMP] = sensors_getRoomTemp();
+		vars[XPR_ROOM_HUM] = sensors_getRoomHum();
+		vars[XPR_MINUTE_OF_DAY] = rtc_hour(curtime) * 60 + rtc_minute(curtime);
+		rls_performActions(rl, xpr_run((uint8_t *)rls_params(rl) + 1, param, vars) != 0 ? curtime : 0);
+		break;
+	}
+	}
+}
+
+// Keep the temperature of the last RLS_RATE_MINUTES minutes
+void rls_recordMinute(int16_t curmins, int8_t temp) {
+	if (historyMinute == -1) {
+		memset(history, temp, sizeof(history));
+	} else if (curmins != historyMinute) {
+		memmove(history + 1, history, RLS_RATE_MINUTES);
+	}
+	history[0] = temp;
+	historyMinute = curmins;
+}
+
+// Check the rules, the kinds they can have and that a ruleset has at most one
+// pid rule. Returns false with the reason in error.
+bool rls_check(RuleSet *ruleset, char *error) {
+	bool pidRule = false;
+	for (int8_t r = 0; r < RLS_MAX_RULES; r++) {
+		Rule *rule = &ruleset->rules[r];
+		if (!rls_isUsed(rule)) {
+			continue;
+		} else if (rule->kind == RLS_HYSTERESIS && rule->band == 0) {
+			sprintf(error, "rules[%d].band: needed by a hysteresis rule", r);
+		} else if (rule->kind == RLS_RATE && rule->minutes == 0) {
+			sprintf(error, "rules[%d].minutes: needed by a rate rule", r);
+		} else if (rule->kind == RLS_PID && pidRule) {
+			sprintf(error, "rules[%d].kind: one pid rule per ruleset", r);
+		} else {
+			pidRule |= rule->kind == RLS_PID;
+			continue;
+		}
+		return false;
+	}
+	return true;
+}
 
 /*****************************************************************
     Public functions (templates in the corresponding header-file)
 ******************************************************************/
 void rls_initEEPROM() {
 	epr_setNrOfRulesetsStored(NR_OF_RULESETS);
-	for (int i = 0; i < NR_OF_RULESETS; i++) {
-		epr_saveRulesetToEEPROM(i, &rulesets[i]);
-	}
+	rls_clear();
+	epr_saveRulesetsToEEPROM(rulesets);
 	epr_saveSprayerRuleToEEPROM(&sprayerRule);
 	logline("EEPROM for rules initialized.");
 }
 
 void rls_init() {
-	for (int i = 0; i < NR_OF_RULESETS; i++) {
-		epr_getRulesetFromEEPROM(i, &rulesets[i]);
-		rulesetActive[i] = rulesets[i].active;
+	epr_getRulesetsFromEEPROM(rulesets);
+	if (epr_getNrOfRulesetsStored() != NR_OF_RULESETS || !rls_isValid(rulesets)) {
+		logline("ERROR: The rulesets in EEPROM are not valid, they are cleared");
+		rls_clear();
+		// an older layout leaves the wrong count and addresses, store them for this one
+		epr_setNrOfRulesetsStored(NR_OF_RULESETS);
+		epr_saveRulesetsToEEPROM(rulesets);
 	}
+	// Nothing is evaluated yet and the sprayer rule does not run
+	evaluated.valid = false;
+	sprayerRuleActive = false;
+	sprayerWasOn = false;
+	rulesetsOff = false;
+	pidWindow = 0;
+	historyMinute = -1;
+	memset(pid, 0, sizeof(pid));
 	epr_getSprayerRuleFromEEPROM(&sprayerRule);
 	for (int i = 0; i < 4; i++) {
 		if (sprayerRule.actions[i].device > 0) {
@@ -80,44 +611,36 @@ void rls_init() {
 }
 */
 void rls_setSprayerRuleFromJson(char *json) {
-	JsonParser<100> parser;
-	JsonHashTable rl = parser.parseHashTable(json);
-	if (!rl.success()) {
+	SprayerRule rule = sprayerRule;
+	char error[BND_ERROR_SIZE];
+	if (!bnd_fromJson(&sprayerRuleSchema, json, &rule, error)) {
 		// create the error response
-		sprintf(json, "{\"error_msg\":\"Could not deserialize the JSON\"}");
-		logline("deserializeJson() failed");
+		sprintf(json, "{\"error_msg\":\"%s\"}", error);
+		logline("Sprayer rule rejected: %s", error);
 		return;
-	} else {
-		int delay = rl.getLong("delay");
-		sprayerRule.delay = delay;
-		JsonArray actions = rl.getArray("actions");
-		for (int8_t i = 0; i < actions.getLength(); i++) {
-			JsonHashTable action = actions.getHashTable(i);
-			char *device = action.getString("device");
-			int16_t on_period = action.getLong("on_period");
-			logline("Sprayer action %d device='%s' on_period=%d", i, device, on_period);
-			sprayerRule.actions[i].device =	gen_getDeviceIndex(device);
-			sprayerRule.actions[i].on_period = on_period;
-		}
-		epr_saveSprayerRuleToEEPROM(&sprayerRule);
 	}
+	sprayerRule = rule;
+	epr_saveSprayerRuleToEEPROM(&sprayerRule);
+	rls_version++;
+	jrn_add(JRN_SPRAYERRULE, -1, rls_version);
 	sprintf(json, "");
 }
 
-void rls_getSprayerRuleAsJson(char *json) {
+void rls_getSprayerRuleAsJson(JsonWriter *jw) {
 	Device *devices = gen_getDevices();
-	char tmp[200];
-	sprintf(tmp, "{\"delay\":%d,\"actions\":[", sprayerRule.delay);
-	strcpy(json, tmp);
+	jw_beginObject(jw);
+	jw_long(jw, "delay", sprayerRule.delay);
+	jw_key(jw, "actions");
+	jw_beginArray(jw);
 	for (int8_t i = 0; i < 4; i++) {
-		Action a = sprayerRule.actions[i];
-		sprintf(tmp, "{\"device\":\"%s\",\"on_period\":%d}", a.device == -1 ? "no device" : devices[a.device].name, a.on_period);
-		if (i != 3) {
-			strcat(tmp, ",");
-		}
-		strcat(json, tmp);
+		Action *a = &sprayerRule.actions[i];
+		jw_beginObject(jw);
+		jw_string(jw, "device", a->device == NO_DEVICE ? "no device" : devices[a->device].name);
+		jw_long(jw, "on_period", a->on_period);
+		jw_endObject(jw);
 	}
-	strcat(json, "]}");
+	jw_endArray(jw);
+	jw_endObject(jw);
 }
 
 void rls_startSprayerRule(time_t curtime) {
@@ -125,6 +648,7 @@ void rls_startSprayerRule(time_t curtime) {
 	stopTime = startTime + max_period;
 	sprayerRuleActive = true;
     sprayerActionsExecuted = false;
+	jrn_add(JRN_SPRAYER_RUN, -1, 1);
 	rls_switchRulesetsOff();
 	logline("Sprayer rule is activated");
 }
@@ -134,26 +658,27 @@ bool rls_isSprayerRuleActive() { // used by the timer checks
 }
 
 void rls_checkSprayerRule(time_t curtime) {
-    logline("Check sprayer rule");
+	bool sprayerOn = gen_isDeviceOn(SPRAYER);
+	if (sprayerWasOn && !sprayerOn) {
+		rls_startSprayerRule(curtime);
+	}
+	sprayerWasOn = sprayerOn;
     if (sprayerRuleActive && curtime > startTime && !sprayerActionsExecuted) {
     	logline("  Sprayer rule actions are executed");
-        // execute the actions
+        // request the actions, they end by themselves
         for (int i = 0; i < 4; i++) {
             if (sprayerRule.actions[i].device > 0) {
-                gen_setDeviceState(sprayerRule.actions[i].device,
-                                   (curtime + sprayerRule.actions[i].on_period),
-                                   0);
+                arb_request(ARB_SPRAYER, sprayerRule.actions[i].device, curtime + sprayerRule.actions[i].on_period);
             }
         }
         sprayerActionsExecuted = true;
     } else if (sprayerRuleActive && curtime > stopTime && sprayerActionsExecuted) {
         sprayerRuleActive = false;
+		jrn_add(JRN_SPRAYER_RUN, -1, 0);
 		// Make all rules that were active, active again
 		rls_switchRulesetsOn();
     	logline("  Sprayer rule is not active anymore");
-    } else if (!sprayerRuleActive) {
-		logline("  Sprayer rule is not active");
-	}
+    }
 }
 
 /*
@@ -166,197 +691,158 @@ void rls_checkSprayerRule(time_t curtime) {
 */
 void rls_setRuleSetFromJson(int8_t setnr, char *json) {
 	logline("Update ruleset %d", setnr);
-	JsonParser<100> parser;
-	JsonHashTable ruleset = parser.parseHashTable(json);
-	if (!ruleset.success()) {
+	RuleSet ruleset;
+	rls_unpack(setnr, &ruleset);
+	char error[BND_ERROR_SIZE];
+	if (!bnd_fromJson(&ruleSetSchema, json, &ruleset, error) || !rls_check(&ruleset, error)) {
 		// create the error response
-		sprintf(json, "{\"error_msg\":\"Could not deserialize the JSON\"}");
-		logline("deserializeJson() failed");
+		sprintf(json, "{\"error_msg\":\"%s\"}", error);
+		logline("Ruleset %d rejected: %s", setnr, error);
 		return;
-	} else {
-		int8_t ruleset_terrarium = ruleset.getLong("terrarium");
-		char *ruleset_active = ruleset.getString("active");
-		char *ruleset_from = ruleset.getString("from");
-		char *ruleset_to = ruleset.getString("to");
-		int8_t ruleset_temp_ideal = ruleset.getLong("temp_ideal");
-//		logline("terrarium %d, active %s, from %s, to %s, ideal %d", ruleset_terrarium, ruleset_active, ruleset_from, ruleset_to, ruleset_temp_ideal);
-		rulesets[setnr].terrarium_nr = ruleset_terrarium;
-		rulesets[setnr].active = strcmp(ruleset_active, "yes") == 0;
-		rulesetActive[setnr] = rulesets[setnr].active;
-		rulesets[setnr].from = atoi(strtok(ruleset_from, ":")) * 60 + atoi(strtok(NULL, ":"));
-		rulesets[setnr].to = atoi(strtok(ruleset_to, ":")) * 60 + atoi(strtok(NULL, ":"));
-		rulesets[setnr].temp_ideal = ruleset_temp_ideal;
-		JsonArray rls = ruleset.getArray("rules");
-		for (int8_t i = 0; i < rls.getLength(); i++) {
-			JsonHashTable rule = rls.getHashTable(i);
-			int8_t value = rule.getLong("value");
-			rulesets[setnr].rules[i].value = value;
-			JsonArray actions = rule.getArray("actions");
-			for (int8_t j = 0; j < actions.getLength(); j++) {
-				JsonHashTable action = actions.getHashTable(j);
-				char *device = action.getString("device");
-				int16_t on_period = action.getLong("on_period");
-				rulesets[setnr].rules[i].actions[j].device = gen_getDeviceIndex(device);
-				rulesets[setnr].rules[i].actions[j].on_period = on_period;
-			}
-		}
-		sprintf(json, "");
-		epr_saveRulesetToEEPROM(setnr, &rulesets[setnr]);
-		logline("Ruleset %d for terrarium %d is updated.", setnr, rulesets[setnr].terrarium_nr);
-	}
-}
-
-void rls_getRuleSetAsJson(int8_t setnr, char *json) {
-	char tmp[100];
-	RuleSet ruleset = rulesets[setnr];
-	sprintf(tmp, "{\"terrarium\":%d, \"active\":\"%s\",", ruleset.terrarium_nr, ruleset.active ? "yes" : "no");
-	strcpy(json, tmp);
-	sprintf(tmp, "\"from\":\"%02d:%02d\",", ruleset.from / 60, ruleset.from - (ruleset.from / 60) * 60);
-	strcat(json, tmp);
-	sprintf(tmp, "\"to\":\"%02d:%02d\",", ruleset.to / 60, ruleset.to - (ruleset.to / 60) * 60);
-	strcat(json, tmp);
-	sprintf(tmp, "\"temp_ideal\":%d,\"rules\":[", ruleset.temp_ideal);
-	strcat(json, tmp);
-	for (int i = 0; i < 2; i++) { // 2 rules
-		sprintf(tmp, "{\"value\":%d, \"actions\":[", ruleset.rules[i].value);
-		strcat(json, tmp);
-		for (int j = 0; j < 4; j++) { // 4 actions
-			sprintf(tmp, "{\"device\":\"%s\",\"on_period\":%d}",
-				(ruleset.rules[i].actions[j].device == -1 ? "no device" : gen_getDevices()[ruleset.rules[i].actions[j].device].name),
-				ruleset.rules[i].actions[j].on_period);
-			strcat(json, tmp);
-			if (j != 3) {
-				strcat(json, ",");
-			} else {
-				strcat(json, "]}");
-			}
-		}
-		if (i != 1) {
-			strcat(json, ",");
-		} else {
-			strcat(json, "]");
-		}
 	}
-	strcat(json, "}");
+	// the stored rules are replaced, nothing is left to release their requests later
+	StoredRuleSet *old = rls_ruleset(setnr);
+	if (old != NULL) {
+		rls_undoRules(old);
+	}
+	if (!rls_pack(setnr, &ruleset)) {
+		sprintf(json, "{\"error_msg\":\"The rulesets do not fit in EEPROM\"}");
+		logline("Ruleset %d rejected: too large", setnr);
+		evaluated.valid = false; // the old rules stay, let them request again
+		return;
+	}
+	thresholdCrossed[setnr] = 0;
+	pid[setnr].integral = 0;
+	pid[setnr].error = 0;
+	sprintf(json, "");
+	epr_saveRulesetsToEEPROM(rulesets);
+	rls_version++;
+	jrn_add(JRN_RULESET, setnr, rls_version);
+	logline("Ruleset %d for terrarium %d is updated.", setnr, ruleset.terrarium_nr);
 }
 
-void rls_performActions(Action *actions, int32_t curtime) {
-	for (int a = 0; a < 4; a++) { // 4 actions per rule
-		if (!gen_isDeviceOnManual(actions[a].device)) {
-			if (actions[a].on_period != 0) { // so -2 (untill ideal value is reached) or >0. -1 (no endtime) is reserved for timers)
-				if (curtime == 0) { // switch off
-					gen_showState("switch off", actions[a].device);
-					if (gen_getEndTime(actions[a].device) == -2) {
-						gen_setDeviceState(actions[a].device, 0, 0);
-					}
-				} else { // switch on
-					gen_showState("switch on ", actions[a].device);
-					// if device is on, don't do anything
-					if (gen_getEndTime(actions[a].device) == 0) {
-						int16_t period = actions[a].on_period;
-						int32_t endtime;
-						if (actions[a].device != -1 && period > 0) {
-							endtime = curtime + period;
-							gen_setDeviceState(actions[a].device, endtime, 1);
-						} else if (actions[a].device != -1 && period <= 0) {
-							gen_setDeviceState(actions[a].device, period, 1);
-						}
-					}
-				}
-			}
+void rls_getRuleSetAsJson(int8_t setnr, JsonWriter *jw) {
+	StoredRuleSet empty = {RLS_EMPTY, 0, false, 0, 0, 0};
+	StoredRuleSet *rlst = rls_ruleset(setnr);
+	if (rlst == NULL) {
+		rlst = &empty;
+	}
+	jw_beginObject(jw);
+	jw_long(jw, "terrarium", rlst->terrarium_nr);
+	jw_string(jw, "active", rlst->active ? "yes" : "no");
+	jw_stringf(jw, "from", "%02d:%02d", rlst->from / 60, rlst->from % 60);
+	jw_stringf(jw, "to", "%02d:%02d", rlst->to / 60, rlst->to % 60);
+	jw_long(jw, "temp_ideal", rlst->temp_ideal);
+	jw_key(jw, "rules");
+	jw_beginArray(jw);
+	for (StoredRule *rl = rls_firstRule(rlst); rlst != &empty && rls_isRule(rlst, rl); rl = rls_nextRule(rl)) {
+		jw_beginObject(jw);
+		int8_t *params = rls_params(rl);
+		if (rl->kind != RLS_EXPR) {
+			jw_long(jw, "value", rl->value);
+		}
+		if (rl->kind != RLS_THRESHOLD) {
+			jw_string(jw, "kind", kindNames[rl->kind]);
+		}
+		if (rl->kind == RLS_HYSTERESIS) {
+			jw_long(jw, "band", params[0]);
+		} else if (rl->kind == RLS_RATE) {
+			jw_long(jw, "minutes", params[0]);
+		} else if (rl->kind == RLS_PID) {
+			jw_long(jw, "kp", params[0]);
+			jw_long(jw, "ki", params[1]);
+			jw_long(jw, "kd", params[2]);
+		} else if (rl->kind == RLS_EXPR) {
+			char text[XPR_MAX_TEXT + 1];
+			xpr_toText((uint8_t *)params + 1, params[0], text);
+			jw_string(jw, "expr", text);
 		}
+		jw_key(jw, "actions");
+		jw_beginArray(jw);
+		for (uint8_t a = 0; a < rl->nr_of_actions; a++) {
+			jw_beginObject(jw);
+			jw_string(jw, "device", gen_getDevices()[rls_actions(rl)[a].device].name);
+			jw_long(jw, "on_period", rls_actions(rl)[a].on_period);
+			jw_endObject(jw);
+		}
+		jw_endArray(jw);
+		jw_endObject(jw);
 	}
+	jw_endArray(jw);
+	jw_endObject(jw);
 }
 
 void rls_checkTempRules(time_t curtime) {
-    logline("Check other rules");
 	int16_t curmins = rtc_hour(curtime) * 60 + rtc_minute(curtime);
-	for (int rs = 0; rs < 2; rs++) { // 2 rulesets
-		RuleSet rlst = rulesets[rs];
-		if (rlst.active) {
-			// rule is now active
-			if (rlst.from > rlst.to) { // period is passing 00:00
-				logline("  Check temperature rules of set %d, active period passing 00:00 hours", rs + 1);
-				if ((curmins >= rlst.from || (curmins <= rlst.from && curmins < rlst.to))) {
-					for (int r = 0; r < 2; r++) { // 2 rules per ruleset
-						Rule rl = rlst.rules[r];
-						if (rl.value < 0 && sensors_getTerrariumTemp() < -rl.value) {
-							// perform actions
-							rls_performActions(rl.actions, curtime);
-						} else if (rl.value < 0 && sensors_getTerrariumTemp() >= rlst.temp_ideal) {
-							// perform actions
-							rls_performActions(rl.actions, 0);
-						} else if (rl.value > 0 && sensors_getTerrariumTemp() > rl.value) {
-							// perform actions
-							rls_performActions(rl.actions, curtime);
-						} else if (rl.value > 0 && sensors_getTerrariumTemp() <= rlst.temp_ideal) {
-							// perform actions
-							rls_performActions(rl.actions, 0);
-						}
-					}
-				} else {
-					for (int r = 0; r < 2; r++) { // 2 rules per ruleset
-						Rule rl = rlst.rules[r];
-						rls_performActions(rl.actions, 0);
-					}
-				}
-			} else { // normal: from < to
-				logline("  Check temperature rules of set %d, normal active period", rs + 1);
-				logline("    from=%d curmins=%d to=%d", rlst.from, curmins, rlst.to);
-				if (rlst.from <= curmins && rlst.to > curmins) {
-					// ruleset is now active
-					for (int r = 0; r < 2; r++) { // 2 rules per ruleset
-						Rule rl = rlst.rules[r];
-						logline("    temp=%d rlvalue=%d", sensors_getTerrariumTemp(), rl.value);
-						if (rl.value < 0 && sensors_getTerrariumTemp() < -rl.value) {
-							// perform actions
-							rls_performActions(rl.actions, curtime);
-						} else if (rl.value < 0 && sensors_getTerrariumTemp() >= rlst.temp_ideal) {
-							// reset actions
-							rls_performActions(rl.actions, 0);
-						} else if (rl.value > 0 && sensors_getTerrariumTemp() > rl.value) {
-							// perform actions
-							rls_performActions(rl.actions, curtime);
-						} else if (rl.value > 0 && sensors_getTerrariumTemp() <= rlst.temp_ideal) {
-							// reset actions
-							rls_performActions(rl.actions, 0);
-						}
-					}
-				} else { // rulest is now not active
-					for (int r = 0; r < 2; r++) { // 2 rules per ruleset
-						Rule rl = rlst.rules[r];
-						rls_performActions(rl.actions, 0);
-					}
+	int8_t temp = sensors_getTerrariumTemp();
+	uint8_t windows = rls_windows(curmins);
+	rls_recordMinute(curmins, temp);
+	bool pidStep = curtime >= pidWindow;
+	if (evaluated.valid && evaluated.rules == rls_version && evaluated.devices == arb_getVersion()
+			&& evaluated.windows == windows && temp >= evaluated.low && temp <= evaluated.high
+			&& !(evaluated.rates && curmins != evaluated.minute) && !(evaluated.pids && pidStep)
+			&& !(evaluated.exprs && (curmins != evaluated.minute || sensors_getVersion() != evaluated.sensors))) {
+		return; // no boundary is crossed
+	}
+	logline("Check temperature rules at %d degrees", temp);
+	for (int8_t rs = 0; rs < NR_OF_RULESETS; rs++) {
+		StoredRuleSet *rlst = rls_ruleset(rs);
+		if (rlst == NULL) {
+			continue;
+		}
+		if (rlst->active && !rulesetsOff) {
+			int8_t r = 0;
+			for (StoredRule *rl = rls_firstRule(rlst); rls_isRule(rlst, rl); rl = rls_nextRule(rl), r++) {
+				if (!(windows & (1 << rs))) { // outside the active period
+					rls_performActions(rl, 0);
+					continue;
 				}
-			}
-		} else { //ruleset is not active
-			if (rulesetWasActive[rs]) {
-				logline("  Undo temperature rules of inactive set %d", rs + 1);
-				for (int r = 0; r < 2; r++) { // 2 rules per ruleset
-					Rule rl = rlst.rules[r];
-					// Undo all actions
-					rls_performActions(rl.actions, 0);
+				if (rl->kind == RLS_THRESHOLD || rl->kind == RLS_HYSTERESIS) {
+					rls_checkThreshold(rs, r, rl->value);
 				}
-				rulesetWasActive[rs] = false;
-			} else {
-				logline("  Ruleset %d is not active", rs);
+				rls_applyRule(rs, rlst, rl, temp, curtime, pidStep);
 			}
+		} else if (rulesetWasActive[rs]) {
+			logline("  Undo temperature rules of inactive set %d", rs + 1);
+			rls_undoRules(rlst);
+			rulesetWasActive[rs] = false;
+		}
+		if (!(windows & (1 << rs))) {
+			pid[rs].integral = 0;
+			pid[rs].error = 0;
 		}
 	}
+	if (pidStep) {
+		pidWindow = curtime + RLS_PID_WINDOW;
+	}
+	// The device changes made above need no new evaluation
+	evaluated.valid = true;
+	evaluated.rules = rls_version;
+	evaluated.devices = arb_getVersion();
+	evaluated.windows = windows;
+	evaluated.minute = curmins;
+	evaluated.sensors = sensors_getVersion();
+	rls_quietRange(windows, temp);
 }
 
 void rls_switchRulesetsOff(void) {
-	rulesetWasActive[0] = rulesetActive[0];
-	rulesetWasActive[1] = rulesetActive[1];
-	// Make all rules inactive
-    rulesets[0].active = false;
-    rulesets[1].active = false;
+	for (int8_t rs = 0; rs < NR_OF_RULESETS; rs++) {
+		StoredRuleSet *rlst = rls_ruleset(rs);
+		rulesetWasActive[rs] = rlst != NULL && rlst->active;
+	}
+	// Make all rules inactive, the rulesets themselves keep their active flag
+	rulesetsOff = true;
+	rls_version++;
 	logline("Rulesets are switched off");
 }
 
 void rls_switchRulesetsOn(void) {
 	// Make all rules active
-    rulesets[0].active = rulesetActive[0];
-    rulesets[1].active = rulesetActive[1];
+	rulesetsOff = false;
+	rls_version++;
 	logline("Rulesets are switched on");
-}
\ No newline at end of file
+}
+
+uint16_t rls_getVersion() {
+	return rls_version;
+}
@@ -17,6 +17,7 @@
 #include <DallasTemperature.h>
 #include <TimeLib.h>
 #endif
+#include "journal.h"
 #include "logger.h"
 #include "terrarium.h"
 #include "sensors.h"
@@ -31,6 +32,7 @@ int8_t room_temp;
 int8_t room_hum;
 bool terrarium_sensor;
 int8_t terrarium_temp;
+uint16_t sensors_version = 0; // increased when a value changes
 
 /**********************
     Private functions
@@ -48,6 +50,9 @@ void sensors_init() {
 }
 
 void sensors_read() {
+	int8_t prev_temp = room_temp;
+	int8_t prev_hum = room_hum;
+	int8_t prev_terrarium = terrarium_temp;
 	float hr = 0.0;
 	float tr = 0.0;
 	float tt = 0.0;
@@ -67,27 +72,49 @@ void sensors_read() {
 			terrarium_temp = 0;
 		}
 	}
+	if (room_temp != prev_temp) {
+		jrn_add(JRN_SENSOR, JRN_ROOM_TEMP, room_temp);
+	}
+	if (room_hum != prev_hum) {
+		jrn_add(JRN_SENSOR, JRN_ROOM_HUM, room_hum);
+	}
+	if (terrarium_temp != prev_terrarium) {
+		jrn_add(JRN_SENSOR, JRN_TERRARIUM_TEMP, terrarium_temp);
+	}
+	if (room_temp != prev_temp || room_hum != prev_hum || terrarium_temp != prev_terrarium) {
+		sensors_version++;
+	}
 	logline("Temp Terrarium=%.1f, Room=%.1f , Hum Room=%.1f", tt, tr, hr);
 }
 
-void sensors_tojson(char *json) {
-    char tmp[100];
+void sensors_tojson(JsonWriter *jw) {
 	int32_t curtime = now();
+	jw_beginObject(jw);
 	// DD-MMM-YYYY hh:mm
-    sprintf(tmp, "{\"clock\":\"%02d-%02d-%4d %02d:%02d\",\"sensors\":", day(curtime), month(curtime), year(curtime), hour(curtime), minute(curtime));
-    strcpy(json, tmp);
-    sprintf(tmp,"[{\"location\":\"room\",\"temperature\":%d,\"humidity\":%d},", room_temp, room_hum);
-    strcat(json, tmp);
-    sprintf(tmp,"{\"location\":\"terrarium\",\"temperature\":%d}]}", terrarium_temp);
-    strcat(json, tmp);
+	jw_stringf(jw, "clock", "%02d-%02d-%4d %02d:%02d", day(curtime), month(curtime), year(curtime), hour(curtime), minute(curtime));
+	jw_key(jw, "sensors");
+	jw_beginArray(jw);
+	jw_beginObject(jw);
+	jw_string(jw, "location", "room");
+	jw_long(jw, "temperature", room_temp);
+	jw_long(jw, "humidity", room_hum);
+	jw_endObject(jw);
+	jw_beginObject(jw);
+	jw_string(jw, "location", "terrarium");
+	jw_long(jw, "temperature", terrarium_temp);
+	jw_endObject(jw);
+	jw_endArray(jw);
+	jw_endObject(jw);
 }
 
-void sensors_setTestValues(char *testurl) {
-	// testurl: [room]/[tt]
-	room_temp = atoi(strtok(testurl, "/"));
+void sensors_setTestValues(int8_t room, int8_t terrarium) {
+	room_temp = room;
 	room_sensor = false;
-	terrarium_temp = atoi(strtok(NULL, "/"));
+	terrarium_temp = terrarium;
 	terrarium_sensor = false;
+	sensors_version++;
+	jrn_add(JRN_SENSOR, JRN_ROOM_TEMP, room_temp);
+	jrn_add(JRN_SENSOR, JRN_TERRARIUM_TEMP, terrarium_temp);
 	logline("Room temp is now %d, terrarium temp is now %d", room_temp, terrarium_temp);
 }
 
@@ -100,7 +127,14 @@ int8_t sensors_getRoomTemp() {
 	return room_temp;
 }
 
+int8_t sensors_getRoomHum() {
+	return room_hum;
+}
+
 int8_t sensors_getTerrariumTemp() {
 	return terrarium_temp;
 }
 
+uint16_t sensors_getVersion() {
+	return sensors_version;
+}
@@ -13,27 +13,66 @@
     Includes
 ******************/
 #include "Arduino.h"
+#include "arbiter.h"
 #include "terrarium.h"
 #include "logger.h"
 #include "eeprom.h"
+#include "journal.h"
 
 /*****************
     Private data
 ******************/
-// EEPROM 250 - 80 = 170 bytes => max 170 / 9 = 18 timers 
+// Names in the order of the device IDs, the last one is NO_DEVICE
+constexpr const char *deviceNames[NR_OF_DEVICES + 1] = {
+	"light1", "light2", "uvlight", "fan_in", "fan_out", "sprayer", "no device"};
+// EEPROM 256 - 26 - 76 for the rulesets = 154 bytes => max 154 / 11 = 14 timers
 Device devices[] = {
-    {"light1",  pin_light1,  1, 0, 0, 0, 0, false},
-    {"light2",  pin_light2,  1, 0, 0, 0, 0, false},
-    {"uvlight", pin_light5,  1, 0, 0, 1, 0, false},
-    {"fan_in",  pin_fan_in,  3, 0, 0, 0, 0, false},
-    {"fan_out", pin_fan_out, 3, 0, 0, 0, 0, false},
-    {"sprayer", pin_sprayer, 3, 0, 0, 0, 0, false}};
+    {deviceNames[LIGHT1],  pin_light1,  1, 0, ARB_NONE, 0, 0, false},
+    {deviceNames[LIGHT2],  pin_light2,  1, 0, ARB_NONE, 0, 0, false},
+    {deviceNames[UVLIGHT], pin_light5,  1, 0, ARB_NONE, 1, 0, false},
+    {deviceNames[FAN_IN],  pin_fan_in,  3, 0, ARB_NONE, 0, 0, false},
+    {deviceNames[FAN_OUT], pin_fan_out, 3, 0, ARB_NONE, 0, 0, false},
+    {deviceNames[SPRAYER], pin_sprayer, 3, 0, ARB_NONE, 0, 0, false}};
+static_assert(sizeof(devices) / sizeof(devices[0]) == NR_OF_DEVICES, "devices[] must have an entry for every device ID");
+// Who a device is switched by, in the order of the ARB_ sources
+const char *const sourceNames[ARB_NR_OF_SOURCES] = {"hand", "the sprayer rule", "a timer", "a rule"};
 bool traceon = true;
+uint16_t gen_version = 0; // increased on every change of the device states or counters
 extern int8_t NR_OF_TIMERS;
 
 /**********************
     Private functions
 **********************/
+constexpr uint8_t gen_length(const char *s) {
+	return *s == 0 ? 0 : 1 + gen_length(s + 1);
+}
+
+constexpr uint16_t gen_hash(const char *s, uint8_t len, uint16_t h) {
+	return len == 0 ? h : gen_hash(s + 1, len - 1, (uint16_t)(h * GEN_DEVICE_HASH + (uint8_t)*s));
+}
+
+#define DEVICE_SLOT(i) (gen_hash(deviceNames[i], gen_length(deviceNames[i]), 0) & (GEN_DEVICE_SLOTS - 1))
+
+// true if no two names after name i share a slot with it
+constexpr bool gen_checkSlots(int8_t i, int8_t j) {
+	return i > NR_OF_DEVICES ? true
+		: j > NR_OF_DEVICES ? gen_checkSlots(i + 1, i + 2)
+		: DEVICE_SLOT(i) == DEVICE_SLOT(j) ? false
+		: gen_checkSlots(i, j + 1);
+}
+
+static_assert(gen_checkSlots(0, 1), "Device names share a hash slot, change GEN_DEVICE_HASH");
+
+// Device ID of the name in the given slot
+constexpr int8_t gen_slot(uint8_t slot, int8_t i) {
+	return i > NR_OF_DEVICES ? UNKNOWN_DEVICE
+		: DEVICE_SLOT(i) == slot ? (i == NR_OF_DEVICES ? NO_DEVICE : i)
+		: gen_slot(slot, i + 1);
+}
+
+#define GEN_SLOTS4(n) gen_slot(n, 0), gen_slot(n + 1, 0), gen_slot(n + 2, 0), gen_slot(n + 3, 0)
+static_assert(GEN_DEVICE_SLOTS == 16, "deviceSlots[] must be extended");
+const int8_t deviceSlots[GEN_DEVICE_SLOTS] = {GEN_SLOTS4(0), GEN_SLOTS4(4), GEN_SLOTS4(8), GEN_SLOTS4(12)};
 
 /*****************************************************************
     Public functions (templates in the corresponding header-file)
@@ -69,16 +108,21 @@ Device *gen_getDevices() {
 	return devices;
 }
 
-int8_t gen_getDeviceIndex(char *device) {
-	if (strcmp(device, "no device") == 0) {
-		return -1;
-	} else {
-		for (int i = 0; i < NR_OF_DEVICES; i++) {
-			if (strcmp(devices[i].name, device) == 0) {
-				return i;
-			}
-		}
+int8_t gen_getDeviceId(const char *name, uint8_t len) {
+	uint16_t h = 0;
+	for (uint8_t i = 0; i < len; i++) {
+		h = h * GEN_DEVICE_HASH + (uint8_t)name[i];
+	}
+	int8_t id = deviceSlots[h & (GEN_DEVICE_SLOTS - 1)];
+	if (id == UNKNOWN_DEVICE) {
+		return UNKNOWN_DEVICE;
+	}
+	// the one name that can be in this slot
+	const char *candidate = deviceNames[id == NO_DEVICE ? NR_OF_DEVICES : id];
+	if (strncmp(candidate, name, len) != 0 || candidate[len] != 0) {
+		return UNKNOWN_DEVICE;
 	}
+	return id;
 }
 
 bool gen_isTraceOn() {
@@ -89,60 +133,46 @@ void gen_setTraceOn(bool on) {
 	traceon = on;
 }
 
-void gen_getProperties(char *json) {
-	char temp[100];
-	strcpy(json, "{\"tcu\":\"TERRARIUM\",");
-	sprintf(temp, "\"eeprom_write_count\":%lu,\"nr_of_timers\":%d,",  epr_getEEPROMWriteCounter(), NR_OF_TIMERS);
-	strcat(json, temp);
-	sprintf(temp, "\"nr_of_programs\":%d,", NR_OF_RULESETS);
-	strcat(json, temp);
-	strcat(json, "\"devices\": [");
+void gen_getProperties(JsonWriter *jw) {
+	jw_beginObject(jw);
+	jw_string(jw, "tcu", "TERRARIUM");
+	jw_long(jw, "eeprom_write_count", epr_getEEPROMWriteCounter());
+	jw_long(jw, "nr_of_timers", NR_OF_TIMERS);
+	jw_long(jw, "nr_of_programs", NR_OF_RULESETS);
+	jw_long(jw, "max_expiry_delay", arb_getMaxDelay());
+	jw_key(jw, "devices");
+	jw_beginArray(jw);
 	for (int i = 0; i < NR_OF_DEVICES; i++) {
-		sprintf(temp, "{\"device\":\"%s\", \"nr_of_timers\":%d, \"lc_counted\": \"%s\"}", 
-			devices[i].name, devices[i].nr_of_timers, devices[i].lcc ? "true" : "false");
-		strcat(json, temp);
-		if (i != NR_OF_DEVICES - 1) {
-			strcat(json, ",");
-		}
+		jw_beginObject(jw);
+		jw_string(jw, "device", devices[i].name);
+		jw_long(jw, "nr_of_timers", devices[i].nr_of_timers);
+		jw_string(jw, "lc_counted", devices[i].lcc ? "true" : "false");
+		jw_endObject(jw);
 	}
-	strcat(json, "]}");
+	jw_endArray(jw);
+	jw_endObject(jw);
 }
 
-void gen_getDeviceStates(char *json) {
-	char temp[100];
-	strcpy(json, "[");
+void gen_getDeviceStates(JsonWriter *jw) {
+	jw_beginArray(jw);
 	for (int i = 0; i < NR_OF_DEVICES; i++) {
-		Device dev = devices[i];
-		int32_t cntr;
-		if (dev.lcc) {
-			cntr = epr_getHoursOn();
-		} else {
-			cntr = 0;
-		}
-		int16_t onTime = dev.on_time / 60;
-		char man[20];
-		sprintf(man,"\"manual\":\"%s\"}", dev.manual ? "yes" : "no");
-		if (dev.end_time > 0) {		  // an endtime is defined
-			time_t tm = dev.end_time; // seconds since 1-1-1970
-			sprintf(temp, "{\"device\":\"%s\",\"state\":\"on\",\"end_time\":\"%02d:%02d:%02d\",\"hours_on\":%d,",
-				dev.name, hour(tm), minute(tm), second(tm), cntr);
-		} else if (dev.end_time == 0) { // off
-			sprintf(temp, "{\"device\":\"%s\",\"state\":\"off\",\"hours_on\":%d,",
-				dev.name, cntr);
-		} else if (dev.end_time == -1) { // on, but endless
-			sprintf(temp, "{\"device\":\"%s\",\"state\":\"on\",\"end_time\":\"no endtime\",\"hours_on\":%d,",
-				dev.name, cntr);
-		} else if (dev.end_time == -2) { // on, untill ideal value is reached
-			sprintf(temp, "{\"device\":\"%s\",\"state\":\"on\",\"end_time\":\"until ideal temperature is reached\",\"hours_on\":%d,",
-				dev.name, cntr);
-		}
-		strcat(temp, man);
-		strcat(json, temp);
-		if (i != NR_OF_DEVICES - 1) {
-			strcat(json, ",");
+		Device *dev = &devices[i];
+		jw_beginObject(jw);
+		jw_string(jw, "device", dev->name);
+		jw_string(jw, "state", dev->end_time == 0 ? "off" : "on");
+		if (dev->end_time > 0) {		  // an endtime is defined
+			time_t tm = dev->end_time; // seconds since 1-1-1970
+			jw_stringf(jw, "end_time", "%02d:%02d:%02d", hour(tm), minute(tm), second(tm));
+		} else if (dev->end_time == -1) { // on, but endless
+			jw_string(jw, "end_time", "no endtime");
+		} else if (dev->end_time == -2) { // on, untill ideal value is reached
+			jw_string(jw, "end_time", "until ideal temperature is reached");
 		}
+		jw_long(jw, "hours_on", dev->lcc ? epr_getHoursOn() : 0);
+		jw_string(jw, "manual", dev->manual ? "yes" : "no");
+		jw_endObject(jw);
 	}
-	strcat(json, "]");
+	jw_endArray(jw);
 }
 
 bool gen_isDeviceOn(int8_t device) {
@@ -153,33 +183,42 @@ int32_t gen_getEndTime(int8_t device) {
 	return devices[device].end_time;
 }
 
-int8_t gen_isSetByRule(int8_t device) {
-	return devices[device].temprule == 0 ? 0 : 1;
+int8_t gen_getSource(int8_t device) {
+	return devices[device].source;
 }
 
 void gen_setDeviceToManual(int8_t device, bool yes) {
-	devices[device].manual = yes;
+	if (devices[device].manual != yes) {
+		devices[device].manual = yes;
+		if (yes) {
+			// it keeps its state, on until the ideal value has no end by hand
+			int32_t end_time = devices[device].end_time;
+			arb_request(ARB_MANUAL, device, end_time == -2 ? -1 : end_time);
+		} else {
+			arb_release(ARB_MANUAL, device);
+		}
+		arb_changed();
+		gen_version++;
+		jrn_add(JRN_MANUAL, device, yes);
+	}
 }
 bool gen_isDeviceOnManual(int8_t device) {
 	return devices[device].manual;
 }
 
 // end_time = 0 -> off, = -1 -> on, endless, = -2 -> on, until ideal value, >0 -> on, seconds from 1-1-1970
-void gen_setDeviceState(int8_t device, int32_t end_time, int8_t temprule) {
-	if (device != -1) {
+void gen_setDeviceState(int8_t device, int32_t end_time, int8_t source) {
+	if (device != NO_DEVICE) {
+		devices[device].source = (end_time == 0 ? ARB_NONE : source);
 		// Check if device state needs to be changed
 		if (devices[device].end_time != end_time) {
-			if (device < 6) {
-				digitalWrite(devices[device].pin_nr, (end_time == 0 ? LOW : HIGH)); //Bjorn
-			} else {
+			// the pin only when it goes on or off
+			if ((devices[device].end_time == 0) != (end_time == 0)) {
 				digitalWrite(devices[device].pin_nr, (end_time == 0 ? LOW : HIGH));
 			}
 			devices[device].end_time = end_time;
-			if (end_time == 0) {
-				devices[device].temprule = 0;
-			} else {
-				devices[device].temprule = temprule;
-			}
+			gen_version++;
+			jrn_add(JRN_DEVICE, device, end_time);
 			char tm[15];
 			if (end_time > 0) {
 				sprintf(tm, "until %02d:%02d:%02d", hour(end_time), minute(end_time), second(end_time));
@@ -187,54 +226,6 @@ void gen_setDeviceState(int8_t device, int32_t end_time, int8_t temprule) {
 			logline("* Device '%s' is switched %s %s", devices[device].name,
 				(end_time == 0 ? "off" : "on"),
 				(end_time == 0 ? "" : (end_time == -1 ? "permanently" : (end_time == -2 ? "until ideal value is reached" : tm))));
-			// Special actions
-			if (device == gen_getDeviceIndex("sprayer") && end_time == 0) { // sprayer is switched off
-				rls_startSprayerRule(rtc_now());
-			}
-			if (device == gen_getDeviceIndex("mist") && end_time != 0) { // mist is switched on
-				rls_switchRulesetsOff();
-			} else if (device == gen_getDeviceIndex("mist") && end_time == 0) { // mist is switched off
-				rls_switchRulesetsOn();
-			}
-		}
-	}
-}
-
-void gen_setDeviceState(char *devurl) {
-	// 'device/on' or 'device/on/xxx' or 'device/off' or 'device/manual' or 'device/auto'
-	char *device = strtok(devurl, "/");
-	int8_t dev = -1;
-	for (int i = 0; i < NR_OF_DEVICES; i++) {
-		if (strcmp(devices[i].name, device) == 0) {
-			dev = i;
-			break;
-		}
-	}
-	if (dev != -1) {
-		int32_t endTime = 0;
-		char *action = strtok(NULL, "/");
-		if (strcmp(action, "on") == 0) {
-			endTime = -1;
-			char *period = strtok(NULL, "/");
-			if (period != NULL) {
-				endTime = now() + atoi(period);
-			}
-			gen_setDeviceState(dev, endTime, false);
-		} else if (strcmp(action, "off") == 0) {
-			gen_setDeviceState(dev, 0, false);
-		} else if (strcmp(action, "manual") == 0) {
-			gen_setDeviceToManual(dev, true);
-		} else if (strcmp(action, "auto") == 0) {
-			gen_setDeviceToManual(dev, false);
-		}
-	}
-}
-
-void gen_checkDeviceStates(time_t curtime) {
-	// Checked every second!
-	for (int i = 0; i < NR_OF_DEVICES; i++) {
-		if (devices[i].end_time > 0 && curtime > devices[i].end_time) {
-			gen_setDeviceState(i, 0, 0); // switch device off
 		}
 	}
 }
@@ -246,31 +237,28 @@ void gen_increase_time_on() {
 			if (devices[i].on_time > 120) {
 				logline("Decrease lifetime with 2 hours");
 				epr_decreaseHoursOn(2); // save every 2 hours
+				gen_version++;
 				devices[i].on_time = 0;
 			}
 		}
 	}
 }
 
-void gen_setCounter(char *devurl) {
-	char *device = strtok(devurl, "/");
-	// Get only the lifecycle devices
-	char lccdev[10];
-	int8_t lcc = 0;
-	for (int i = 0; i < NR_OF_DEVICES; i++) {
-		if (devices[i].lcc) {
-			strcpy(lccdev, devices[i].name);
-			break;
-		}
-	}
-	logline("lcc device is '%s'", lccdev);
-	if (strcmp(lccdev, device) == 0) {
-		int32_t value = atoi(strtok(NULL, "/"));
+void gen_setCounter(int8_t device, int32_t value) {
+	// Only the lifecycle counted device has a counter
+	if (devices[device].lcc) {
 		epr_setHoursOn(value);
-		logline("Counter for device '%s' is set to %d", lccdev, value);
+		gen_version++;
+		logline("Counter for device '%s' is set to %ld", devices[device].name, (long)value);
+	} else {
+		logline("Device '%s' has no lifecycle counter", devices[device].name);
 	}
 }
 
+uint16_t gen_getVersion() {
+	return gen_version;
+}
+
 void gen_showState(char * txt, int8_t device) {
 	char state1[35];
 	if (devices[device].end_time > 0) {
@@ -282,15 +270,10 @@ void gen_showState(char * txt, int8_t device) {
 	} else if (devices[device].end_time == -2) {
 		strcpy(state1, "on until ideal value is reached");
 	}
-	char state2[25];
-	if (devices[device].temprule == 0) {
-		strcpy(state2, "a timer");
-	} else if (devices[device].temprule != 0) {
-		strcpy(state2, "a rule");
-	}
 	if (devices[device].end_time == 0) {
 		logline("  ->%s : Device %s (%s) is off", txt, devices[device].name, devices[device].manual ? "manual" : "auto");
 	} else {
-		logline("  ->%s : Device %s (%s) is %s set by %s", txt, devices[device].name, devices[device].manual ? "manual" : "auto", state1, state2);
+		logline("  ->%s : Device %s (%s) is %s set by %s", txt, devices[device].name, devices[device].manual ? "manual" : "auto", state1,
+			sourceNames[devices[device].source]);
 	}
 }
\ No newline at end of file
@@ -12,55 +12,194 @@
 /*****************
     Includes
 ******************/
+#include <string.h>
 #include "timers.h"
+#include "arbiter.h"
 #include "eeprom.h"
 #include "logger.h"
 #include "terrarium.h"
 #include "rtc.h"
-#include <JsonParser.h>
+#include "binder.h"
+#include "journal.h"
 /*****************
     Private data
 ******************/
 int8_t NR_OF_TIMERS;
-static Timer timers[20];
+static Timer timers[MAX_NR_OF_TIMERS];
+// The timers of a device are in one row, device d has the slots firstTimer[d] up to firstTimer[d + 1]
+static uint8_t firstTimer[NR_OF_DEVICES + 1];
+uint16_t tmr_version = 0; // increased on every change of the timers
+
+// The timers as a day of events, sorted on minute and action. A timer with a
+// period is one TMR_PULSE at minutes_on, else it is a TMR_OPEN at minutes_on
+// and a TMR_CLOSE at minutes_off.
+#define TMR_CLOSE 0
+#define TMR_OPEN  1
+#define TMR_PULSE 2
+typedef struct __attribute__((packed)) { // 3 bytes
+	uint16_t minute : 11;
+	uint16_t action : 2;
+	uint8_t timer;          // index in timers[]
+} Event;
+static Event events[2 * MAX_NR_OF_TIMERS];
+static uint8_t nrOfEvents = 0;
+static uint8_t nextEvent = 0;        // the first event that is not due yet
+static int16_t lastMinute = -1;      // of the last check, -1: none yet
+static bool rebuilt = false;         // the events changed since the last check
+static uint8_t openWindows[NR_OF_DEVICES]; // per device the TMR_OPENs without their TMR_CLOSE yet
+static uint16_t today = 0;           // day number since 1-1-1970 of the last resync
+static uint8_t runsToday[(MAX_NR_OF_TIMERS + 7) / 8]; // bit i % 8 of byte i / 8 set: timers[i] runs today
+static_assert(2 * MAX_NR_OF_TIMERS <= 255, "an event is counted in a uint8_t");
+
+// Bit n of Timer.weekdays, sunday is weekday(t) 1
+const char *const weekdayNames[7] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
+// The JSON of one timer
+const Field timerFields[] = {
+	BND_FIELD(Timer, "device",     device,         BND_DEVICE, 0, 0),
+	BND_FIELD(Timer, "index",      index,          BND_INT8,   1, MAX_NR_OF_TIMERS),
+	BND_FIELD(Timer, "hour_on",    minutes_on,     BND_HOUR,   0, 23),
+	BND_FIELD(Timer, "minute_on",  minutes_on,     BND_MINUTE, 0, 59),
+	BND_FIELD(Timer, "hour_off",   minutes_off,    BND_HOUR,   0, 23),
+	BND_FIELD(Timer, "minute_off", minutes_off,    BND_MINUTE, 0, 59),
+	BND_FIELD(Timer, "repeat",     repeat_in_days, BND_INT8,   0, 7),
+	BND_FLAGS_OF(Timer, "days",    weekdays,       weekdayNames),
+	BND_FIELD(Timer, "period",     on_period,      BND_INT16,  0, 3600)
+};
+const Schema timerSchema = BND_SCHEMA(timerFields);
 
 /**********************
     Private functions
 **********************/
+// Build the sorted events of the timers, only when a timer is changed
+void tmr_buildEvents() {
+	nrOfEvents = 0;
+	for (uint8_t i = 0; i < NR_OF_TIMERS; i++) {
+		Timer *t = &timers[i];
+		if (t->repeat_in_days == 0 || t->device < 0 || t->device >= NR_OF_DEVICES) {
+			continue;
+		} else if (t->on_period > 0) {
+			events[nrOfEvents++] = {(uint16_t)t->minutes_on, TMR_PULSE, i};
+		} else if (t->minutes_on < t->minutes_off) {
+			events[nrOfEvents++] = {(uint16_t)t->minutes_on, TMR_OPEN, i};
+			events[nrOfEvents++] = {(uint16_t)t->minutes_off, TMR_CLOSE, i};
+		}
+	}
+	// insertion sort, the few events are nearly sorted already
+	for (uint8_t i = 1; i < nrOfEvents; i++) {
+		Event e = events[i];
+		int8_t j = i - 1;
+		while (j >= 0 && (events[j].minute > e.minute || (events[j].minute == e.minute && events[j].action > e.action))) {
+			events[j + 1] = events[j];
+			j--;
+		}
+		events[j + 1] = e;
+	}
+	rebuilt = true;
+}
+
+// true if the timer runs on the day, 1-1-1970 (day 0) was a thursday
+bool tmr_runsOn(Timer *t, uint16_t day) {
+	return t->repeat_in_days > 0 && (t->weekdays >> ((day + 4) % 7)) & 1 && day % t->repeat_in_days == t->phase;
+}
+
+// Set the windows to how they were just before minute from of the day and continue with the events of from
+void tmr_resync(uint16_t day, int16_t from) {
+	today = day;
+	memset(runsToday, 0, sizeof(runsToday));
+	memset(openWindows, 0, sizeof(openWindows));
+	for (uint8_t i = 0; i < NR_OF_TIMERS; i++) {
+		Timer *t = &timers[i];
+		if (!tmr_runsOn(t, day)) {
+			continue;
+		}
+		runsToday[i / 8] |= 1 << (i % 8);
+		if (t->device >= 0 && t->device < NR_OF_DEVICES && t->on_period == 0
+				&& t->minutes_on < from && from <= t->minutes_off) {
+			openWindows[t->device]++;
+		}
+	}
+	for (int8_t d = 0; d < NR_OF_DEVICES; d++) {
+		if (openWindows[d] > 0) {
+			arb_request(ARB_TIMER, d, -1);
+		} else if (arb_getRequest(ARB_TIMER, d) == -1) {
+			arb_release(ARB_TIMER, d);
+		}
+	}
+	for (nextEvent = 0; nextEvent < nrOfEvents && events[nextEvent].minute < from; nextEvent++) {
+	}
+}
+
+// Request the device of the event on or release it, the arbiter decides between the timers and the rules
+void tmr_fire(Event *e, time_t curtime) {
+	Timer *t = &timers[e->timer];
+	if (!((runsToday[e->timer / 8] >> (e->timer % 8)) & 1)) {
+		return; // not its day
+	}
+	if (e->action == TMR_OPEN && ++openWindows[t->device] == 1) {
+		arb_request(ARB_TIMER, t->device, -1);
+	} else if (e->action == TMR_CLOSE && openWindows[t->device] > 0 && --openWindows[t->device] == 0) {
+		arb_release(ARB_TIMER, t->device);
+	} else if (e->action == TMR_PULSE && openWindows[t->device] == 0) {
+		arb_request(ARB_TIMER, t->device, curtime + t->on_period); // it runs out by itself
+	}
+}
+
+// Also fills firstTimer, the timers are laid out in the order of the devices
 int8_t tmr_getNrOfTimers() {
 	Device *devices = gen_getDevices();
-	int8_t nr = 0;
-	for (int i = 0; i < NR_OF_DEVICES; i++) {
+	int16_t nr = 0;
+	for (int8_t i = 0; i < NR_OF_DEVICES; i++) {
+		firstTimer[i] = nr;
 		nr += devices[i].nr_of_timers;
 	}
+	firstTimer[NR_OF_DEVICES] = nr;
 	if (nr > MAX_NR_OF_TIMERS) {
 		logline("FATAL: Total number of timers (%d) exceeds maximum (%d)", nr, MAX_NR_OF_TIMERS);
+		memset(firstTimer, 0, sizeof(firstTimer));
 		nr = 0;
 	}
 	return nr;
 }
 
+// The slot of timer index (1, 2, ...) of the device, or -1
 int8_t tmr_getIndex(int8_t device, int8_t index) {
-	for (int i = 0; i < NR_OF_TIMERS; i++) {
-		if (timers[i].device == device && timers[i].index == index) {
-			return i;
+	if (device >= 0 && device < NR_OF_DEVICES && index > 0 && index <= firstTimer[device + 1] - firstTimer[device]) {
+		int8_t ix = firstTimer[device] + index - 1;
+		if (timers[ix].device == device && timers[ix].index == index) {
+			return ix;
 		}
 	}
 	logline("ERROR: Invalid index: %d", index);
 	return -1;
 }
 
-int8_t tmr_setTimerValues(int8_t device, int8_t index, int16_t minutes_on, int16_t minutes_off, int16_t period, int8_t repeat) {
-	int8_t ix = -1;
-	for (int8_t i = 0; i < NR_OF_TIMERS; i++) {
-		if (timers[i].device == device && timers[i].index == index) {
-			timers[i].minutes_on = minutes_on;
-			timers[i].minutes_off = minutes_off;
-			timers[i].on_period = period;
-			timers[i].repeat_in_days = repeat;
-			ix = i;
-		}
+// true if the slot holds a timer of this layout: its device and index and values in range
+bool tmr_isValid(uint8_t ix) {
+	Timer *t = &timers[ix];
+	return t->device >= 0 && t->device < NR_OF_DEVICES && ix >= firstTimer[t->device] && ix < firstTimer[t->device + 1]
+		&& t->index == ix - firstTimer[t->device] + 1
+		&& t->minutes_on >= 0 && t->minutes_on < 1440 && t->minutes_off >= 0 && t->minutes_off < 1440
+		&& t->on_period >= 0 && t->on_period <= 3600 && t->repeat_in_days >= 0 && t->repeat_in_days <= 7
+		&& t->weekdays > 0 && t->weekdays <= TMR_EVERY_DAY && t->phase < (t->repeat_in_days > 0 ? t->repeat_in_days : 1);
+}
+
+int8_t tmr_setTimerValues(int8_t device, int8_t index, int16_t minutes_on, int16_t minutes_off, int16_t period, int8_t repeat,
+		uint8_t weekdays) {
+	int8_t ix = tmr_getIndex(device, index);
+	if (ix == -1) {
+		return -1;
+	}
+	Timer *t = &timers[ix];
+	t->minutes_on = minutes_on;
+	t->minutes_off = minutes_off;
+	t->on_period = period;
+	if (t->repeat_in_days != repeat || t->phase >= repeat) {
+		// the days are counted from today
+		t->phase = repeat > 0 ? rtc_now() / SECS_PER_DAY % repeat : 0;
 	}
+	t->repeat_in_days = repeat;
+	t->weekdays = weekdays;
 	return ix;
 }
 
@@ -73,7 +212,8 @@ void tmr_initEEPROM() {
 	int ix = 0;
 	for (int8_t i = 0; i < NR_OF_DEVICES; i++) {
 		for (int8_t j = 1; j <= devices[i].nr_of_timers; j++) {
-			timers[ix] = {.device = i, .index = j, .minutes_on = 0, .minutes_off = 0, .on_period = 0, .repeat_in_days = 0};
+			timers[ix] = {.device = i, .index = j, .minutes_on = 0, .minutes_off = 0, .on_period = 0, .repeat_in_days = 0,
+				.weekdays = TMR_EVERY_DAY, .phase = 0};
 			ix++;
 			if (ix > NR_OF_TIMERS) {
 				logline("ERROR: exceeding the NR_OF_TIMERS");
@@ -96,8 +236,17 @@ void tmr_init() {
 	int8_t hr_on, min_on, hr_off, min_off;
 	char tmp[200];
 	logline("Registered timers");
+	bool valid = epr_getNrOfTimersStored() == NR_OF_TIMERS;
 	for (int i = 0; i < NR_OF_TIMERS; i++) {
 		epr_getTimerFromEEPROM(i, &timers[i]);
+		valid = valid && tmr_isValid(i);
+	}
+	if (!valid) {
+		// e.g. written by a firmware with another size of Timer
+		logline("ERROR: The timers in EEPROM are not valid, they are cleared");
+		tmr_initEEPROM();
+	}
+	for (int i = 0; i < NR_OF_TIMERS; i++) {
 		if (timers[i].device != 0 &&timers[i].repeat_in_days == 1) {
 			hr_on = timers[i].minutes_on / 60;
 			min_on = timers[i].minutes_on - hr_on * 60;
@@ -108,6 +257,7 @@ void tmr_init() {
 			logline(tmp);
 		}
 	}
+	tmr_buildEvents();
 }
 
 void tmr_dump(char *prefix) {
@@ -128,157 +278,92 @@ void tmr_dump(char *prefix) {
 }
 
 void tmr_check(time_t curtime) {
-	if (!rls_isSprayerRuleActive()) { // If sprayer rule is active, skip 
-		logline("Check timers");
-	    Timer curtimer;
-	    Timer acttimer;
-	    int8_t shouldBeOn = 0;
-	    int8_t device = 0;
-	    int16_t curmins = rtc_hour(curtime) * 60 + rtc_minute(curtime);
-	    Timer t;
-	    for (int8_t i = 0; i <= NR_OF_TIMERS; i++) {
-		    if (i < NR_OF_TIMERS) {
-			    t = timers[i];
-			    device = t.device;
-		    } else {
-			    device = 0;
-		    }
-		    if (i > 0) {
-			    if (device != curtimer.device) {
-					if (!gen_isDeviceOnManual(curtimer.device)) {
-						if (shouldBeOn == 1) {
-							int8_t setByRule = gen_isSetByRule(acttimer.device);
-							int32_t endtime = gen_getEndTime(acttimer.device);
-							if (endtime == -2 && setByRule == 1) {
-								rls_switchRulesetsOff(); // timer has higher prio 
-							}
-							if (acttimer.on_period > 0) {
-								endtime = curtime + acttimer.on_period;
-								gen_showState("switch on period > 0", acttimer.device);
-								gen_setDeviceState(acttimer.device, endtime, setByRule);
-							} else {
-								gen_showState("switch on period <=0", acttimer.device);
-								gen_setDeviceState(acttimer.device, -1, setByRule);
-							}
-						} else { // should be off
-							int8_t setByRule = gen_isSetByRule(curtimer.device);
-							int32_t endtime = gen_getEndTime(curtimer.device);
-							gen_showState("switch off", curtimer.device);
-							if (endtime == -1 && setByRule == 1) { // timer had overruled rule
-								rls_switchRulesetsOn(); // rules can be activated again 
-								gen_setDeviceState(curtimer.device, -2, 1); // and device is on according to rule
-							}
-							if (setByRule == 0) {
-								gen_setDeviceState(curtimer.device, 0, 0);
-							}
-						}
-					}
-					shouldBeOn = 0;
-				}
-			}
-			if (i < NR_OF_TIMERS) {
-				if (t.repeat_in_days > 0) {
-					if ((curmins >= t.minutes_on && curmins < t.minutes_off) || (curmins == t.minutes_on && t.on_period > 0)) {
-						shouldBeOn = 1;
-						acttimer = t;
-					}
-				}
-				curtimer = t;
-			}
-	    }
-	} else {
-		logline("Timers not checked because sprayer rule is active");
+	uint16_t day = curtime / SECS_PER_DAY;
+	int16_t curmins = rtc_hour(curtime) * 60 + rtc_minute(curtime);
+	if (day != today || curmins < lastMinute || lastMinute == -1) {
+		tmr_resync(day, curmins); // a new day or the clock went back
+	} else if (rebuilt) {
+		tmr_resync(day, lastMinute + 1); // the timers changed, what fired up to lastMinute does not fire again
+	}
+	rebuilt = false;
+	while (nextEvent < nrOfEvents && events[nextEvent].minute <= curmins) {
+		tmr_fire(&events[nextEvent], curtime);
+		nextEvent++;
 	}
+	lastMinute = curmins;
 }
+
 /*
-[
-    {"device": "light1","index":1,"hour_on": 9,"minute_on": 0,"hour_off":21,"minute_off": 0,"repeat": 1, "period": 0},
-    {"device": "light2","index":1,"hour_on": 9,"minute_on": 30,"hour_off":21,"minute_off": 30,"repeat": 1, "period": 0},
-    {"device": "sprayer","index":1,"hour_on": 0,"minute_on": 0,"hour_off":0,"minute_off": 0,"repeat": 0, "period": 0},
-    {"device": "sprayer","index":2,"hour_on": 0,"minute_on": 0,"hour_off":0,"minute_off": 0,"repeat": 0, "period": 0},
-    {"device": "sprayer","index":3,"hour_on": 0,"minute_on": 0,"hour_off":0,"minute_off": 0,"repeat": 0, "period": 0}
-]
+The body of PUT /timers is an array of these, each one is passed on its own:
+    {"device": "light1","index":1,"hour_on": 9,"minute_on": 0,"hour_off":21,"minute_off": 0,"repeat": 1, "period": 0}
+"repeat" is every that many days, counted from the day it is set, and the optional "days" like "mon,wed,fri"
+limits it to those weekdays.
 */
-void tmr_setTimersFromJson(char *json) {
-	JsonParser<100> parser;
-	JsonArray timerArray = parser.parseArray(json);
-	if (!timerArray.success()) {
-		// create the error response
-		sprintf(json, "{\"error_msg\":\"Could not deserialize the JSON\"}");
-		logline("deserializeJson() failed");
-		return;
-	} else {
-		char tmp[100];
-		for (int8_t i = 0; i < timerArray.getLength(); i++) {
-			JsonHashTable tmr = timerArray.getHashTable(i);
-			int8_t dev = gen_getDeviceIndex(tmr.getString("device"));
-			int8_t ix = tmr.getLong("index");
-			int8_t hr_on = tmr.getLong("hour_on");
-			int8_t min_on = tmr.getLong("minute_on");
-			int8_t hr_off = tmr.getLong("hour_off");
-			int8_t min_off = tmr.getLong("minute_off");
-			int8_t repeat = tmr.getLong("repeat");
-			int16_t period = tmr.getLong("period");
-			int16_t all_on = hr_on * 60 + min_on;
-			int16_t all_off = hr_off * 60 + min_off;
-			int8_t tix = tmr_setTimerValues(dev, ix, all_on, all_off, period, repeat);
-			// tmp[0] = 0;
-			// tmr_getTimerAsJson(dev, ix, tmp);
-			// Serial1.println(tmp);
-			epr_saveTimerToEEPROM(tix, &timers[tix]);
-			// Timer t;
-			// epr_getTimerFromEEPROM(tix, &t);
-			// tmp[0] = 0;
-			// tmr_getTimerAsJson(&t, tmp);
-			// Serial1.println(tmp);
-		}
-		sprintf(json, "");
+bool tmr_setTimerFromJson(char *json, char *error) {
+	Timer t = {-1, 0, 0, 0, 0, 1, TMR_EVERY_DAY, 0};
+	if (!bnd_fromJson(&timerSchema, json, &t, error)) {
+		logline("Timer rejected: %s", error);
+		return false;
+	}
+	int8_t tix = tmr_setTimerValues(t.device, t.index, t.minutes_on, t.minutes_off, t.on_period, t.repeat_in_days, t.weekdays);
+	if (tix == -1) {
+		sprintf(error, "index: timer %d of this device does not exist", t.index);
+		logline("Timer %d of device %d does not exist", t.index, t.device);
+		return false;
 	}
+	epr_saveTimerToEEPROM(tix, &timers[tix]);
+	tmr_buildEvents();
+	tmr_version++;
+	jrn_add(JRN_TIMERS, t.device, tmr_version);
+	return true;
 }
 
-void tmr_getTimerAsJson(Timer *t, char *json) {
+void tmr_getTimerAsJson(Timer *t, JsonWriter *jw) {
 	Device *devices = gen_getDevices();
-	int8_t hr_on, min_on, hr_off, min_off;
-	hr_on = t->minutes_on / 60;
-	min_on = t->minutes_on - hr_on * 60;
-	hr_off = t->minutes_off / 60;
-	min_off = t->minutes_off - hr_off * 60;
-	char tmp[200];
-	sprintf(tmp,
-		"{\"device\":\"%s\",\"index\":%d,\"hour_on\":%d,\"minute_on\":%d,\"hour_off\":%d,\"minute_off\":%d,\"repeat\":%d,\"period\":%d}",
-		devices[t->device].name, t->index, hr_on, min_on, hr_off, min_off, t->repeat_in_days, t->on_period);
-	strcat(json, tmp);
+	jw_beginObject(jw);
+	jw_string(jw, "device", devices[t->device].name);
+	jw_long(jw, "index", t->index);
+	jw_long(jw, "hour_on", t->minutes_on / 60);
+	jw_long(jw, "minute_on", t->minutes_on % 60);
+	jw_long(jw, "hour_off", t->minutes_off / 60);
+	jw_long(jw, "minute_off", t->minutes_off % 60);
+	jw_long(jw, "repeat", t->repeat_in_days);
+	if (t->weekdays != TMR_EVERY_DAY) {
+		char days[28] = "";
+		for (uint8_t n = 0; n < 7; n++) {
+			if ((t->weekdays >> n) & 1) {
+				strcat(days, days[0] == 0 ? "" : ",");
+				strcat(days, weekdayNames[n]);
+			}
+		}
+		jw_string(jw, "days", days);
+	}
+	jw_long(jw, "period", t->on_period);
+	jw_endObject(jw);
 }
 
-void tmr_getTimerAsJson(int8_t dev, int8_t ix, char *json) {
+void tmr_getTimerAsJson(int8_t dev, int8_t ix, JsonWriter *jw) {
 	Device *devices = gen_getDevices();
-	if (devices[dev].nr_of_timers > 0 && ix > 0 && devices[dev].nr_of_timers <= ix) {
+	if (ix > 0 && ix <= devices[dev].nr_of_timers) {
 		int8_t tix = tmr_getIndex(dev, ix);
 		if (tix != -1) {
-			Timer t = timers[tix];
-			tmr_getTimerAsJson(&t, json);
+			tmr_getTimerAsJson(&timers[tix], jw);
 		} else {
 			logline("ERROR: no timer for dev=%d, index=%d", dev, ix);
 		}
 	}
 }
 
-void tmr_getTimersAsJson(char *device, char *json) {
-	Device *devices = gen_getDevices();
-	int8_t dev = gen_getDeviceIndex(device);
-	strcpy(json, "[");
-	if (devices[dev].nr_of_timers > 0) {
-		int8_t rc = 0;
-		int8_t n = devices[dev].nr_of_timers;
-		for (int i = 0; i < n; i++) {
-			int8_t ix = tmr_getIndex(dev, i + 1);
-			if (ix != -1) {
-				tmr_getTimerAsJson(&timers[ix], json);
-				if (i != (n - 1)) {
-					strcat(json, ",");
-				}
-			}
+void tmr_getTimersAsJson(int8_t dev, JsonWriter *jw) {
+	jw_beginArray(jw);
+	for (uint8_t ix = firstTimer[dev]; ix < firstTimer[dev + 1]; ix++) {
+		if (timers[ix].device == dev) { // else the EEPROM does not hold the layout of the devices
+			tmr_getTimerAsJson(&timers[ix], jw);
 		}
 	}
-	strcat(json, "]");
+	jw_endArray(jw);
+}
+
+uint16_t tmr_getVersion() {
+	return tmr_version;
 }
@@ -0,0 +1,196 @@
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 20-3-2021
+* File : bench_json.cpp
+* Cycles per byte of tokenizing, setting from JSON and writing JSON
+* for a ruleset, the sprayer rule and a timer.
+*
+* Run:     pio run -e bench && .pio/build/bench/program
+* Compare: .pio/build/bench/program test/bench/baseline.txt
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "utility/jsmn.h"
+#include "binder.h"
+#include "jsonwriter.h"
+#include "native.h"
+#include "rules.h"
+#include "terrarium.h"
+#include "timers.h"
+
+/*****************
+    Defines
+******************/
+#define BENCH_LOOPS   2000  // per measurement
+#define BENCH_ROUNDS    15  // the best round counts
+#define BENCH_TEXT_SIZE 1300
+
+/*****************
+    Private data
+******************/
+const char *ruleset =
+	"{\"terrarium\":1,\"active\":\"yes\",\"from\":\"09:00\",\"to\":\"21:30\",\"temp_ideal\":25,\"rules\":["
+	"{\"value\":-22,\"actions\":[{\"device\":\"light2\",\"on_period\":-2},{\"device\":\"no device\",\"on_period\":0},"
+	"{\"device\":\"no device\",\"on_period\":0},{\"device\":\"no device\",\"on_period\":0}]},"
+	"{\"value\":28,\"actions\":[{\"device\":\"fan_in\",\"on_period\":-2},{\"device\":\"fan_out\",\"on_period\":-2},"
+	"{\"device\":\"no device\",\"on_period\":0},{\"device\":\"no device\",\"on_period\":0}]}]}";
+const char *sprayerRule =
+	"{\"delay\":15,\"actions\":[{\"device\":\"fan_in\",\"on_period\":900},{\"device\":\"fan_out\",\"on_period\":900},"
+	"{\"device\":\"no device\",\"on_period\":0},{\"device\":\"no device\",\"on_period\":0}]}";
+const char *timer =
+	"{\"device\":\"light1\",\"index\":1,\"hour_on\":9,\"minute_on\":30,\"hour_off\":21,\"minute_off\":0,\"repeat\":1,\"period\":0}";
+char text[BENCH_TEXT_SIZE];
+BufferPrint out;
+const char *payload;
+int8_t light1;
+
+/**********************
+    Private functions
+**********************/
+uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	// no cycle counter: nanoseconds
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+void tokenize() {
+	jsmn_parser parser;
+	jsmntok_t *tokens = jsmn_borrow();
+	jsmn_init(&parser);
+	jsmn_parse(&parser, payload, strlen(payload), tokens, JSMN_ARENA_SIZE);
+	jsmn_return();
+}
+
+// The setters may write an answer into the text, so each run gets a fresh copy
+void setRuleset() {
+	strcpy(text, payload);
+	rls_setRuleSetFromJson(0, text);
+}
+
+void setSprayerRule() {
+	strcpy(text, payload);
+	rls_setSprayerRuleFromJson(text);
+}
+
+void setTimer() {
+	char error[BND_ERROR_SIZE];
+	strcpy(text, payload);
+	tmr_setTimerFromJson(text, error);
+}
+
+void write(void (*get)(JsonWriter *jw)) {
+	JsonWriter jw;
+	out.clear();
+	jw_init(&jw, &out, false, false);
+	get(&jw);
+	jw_end(&jw);
+}
+
+void getRuleset(JsonWriter *jw) {
+	rls_getRuleSetAsJson(0, jw);
+}
+
+void getTimer(JsonWriter *jw) {
+	tmr_getTimerAsJson(light1, 1, jw);
+}
+
+void writeRuleset() {
+	write(getRuleset);
+}
+
+void writeSprayerRule() {
+	write(rls_getSprayerRuleAsJson);
+}
+
+void writeTimer() {
+	write(getTimer);
+}
+
+// Best cycles per byte of run() over bytes
+double measure(void (*run)(), uint16_t bytes) {
+	double best = 1e30;
+	for (uint8_t r = 0; r < BENCH_ROUNDS; r++) {
+		uint64_t start = cycles();
+		for (uint16_t i = 0; i < BENCH_LOOPS; i++) {
+			run();
+		}
+		double perByte = (double)(cycles() - start) / BENCH_LOOPS / bytes;
+		if (perByte < best) {
+			best = perByte;
+		}
+	}
+	return best;
+}
+
+// The value of name in the baseline file, 0 if it is not there
+double baseline(const char *file, const char *name) {
+	char line[80];
+	char key[40];
+	double value;
+	FILE *f = (file == NULL ? NULL : fopen(file, "r"));
+	if (f == NULL) {
+		return 0;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (line[0] != '#' && sscanf(line, "%39s %lf", key, &value) == 2 && strcmp(key, name) == 0) {
+			fclose(f);
+			return value;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+void report(const char *file, const char *name, void (*run)(), uint16_t bytes) {
+	double perByte = measure(run, bytes);
+	double base = baseline(file, name);
+	printf("%-20s %8.1f", name, perByte);
+	if (base > 0) {
+		printf("   %+6.1f%%", (perByte - base) * 100 / base);
+	}
+	printf("\n");
+}
+
+/*****************************************************************
+    Public functions (templates in the corresponding header-file)
+******************************************************************/
+int main(int argc, char **argv) {
+	const char *file = (argc > 1 ? argv[1] : NULL);
+	native_setup();
+	light1 = LIGHT1;
+	printf("# cycles per byte%s\n", file == NULL ? "" : ", change against the baseline");
+	payload = ruleset;
+	report(file, "tokenize.ruleset", tokenize, strlen(payload));
+	report(file, "set.ruleset", setRuleset, strlen(payload));
+	writeRuleset();
+	report(file, "write.ruleset", writeRuleset, out.len);
+	payload = sprayerRule;
+	report(file, "tokenize.sprayer", tokenize, strlen(payload));
+	report(file, "set.sprayer", setSprayerRule, strlen(payload));
+	writeSprayerRule();
+	report(file, "write.sprayer", writeSprayerRule, out.len);
+	payload = timer;
+	report(file, "tokenize.timer", tokenize, strlen(payload));
+	report(file, "set.timer", setTimer, strlen(payload));
+	writeTimer();
+	report(file, "write.timer", writeTimer, out.len);
+	return 0;
+}
@@ -0,0 +1,193 @@
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 20-3-2021
+* File : fuzz_json.cpp
+* Fuzz target for the JSON parsers and the JSON setters.
+* The first byte of the input selects the target, the rest is the text.
+*
+* libFuzzer: build the fuzz env with clang and add
+*            -D FUZZ_LIBFUZZER -fsanitize=fuzzer to its build_flags
+* AFL:       build with afl-g++ (CXX=afl-g++), the input is read from stdin
+* Replay:    .pio/build/fuzz/program followed by the files in test/fuzz/corpus
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <JsonParser.h>
+#include "utility/jsmn.h"
+#include "binder.h"
+#include "jsonwriter.h"
+#include "native.h"
+#include "rules.h"
+#include "terrarium.h"
+#include "timers.h"
+
+/*****************
+    Defines
+******************/
+#define FUZZ_JSMN       0  // one pass and byte by byte must give the same tokens
+#define FUZZ_HASHTABLE  1
+#define FUZZ_RULESET    2
+#define FUZZ_SPRAYER    3
+#define FUZZ_TIMER      4
+#define FUZZ_NUMBERS    5  // the typed parsers against strtol
+#define FUZZ_TARGETS    6  // '0' selects target 0 as well
+#define FUZZ_TEXT_SIZE  1300
+
+/*****************
+    Private data
+******************/
+char text[FUZZ_TEXT_SIZE];
+bool started = false;
+BufferPrint out;
+
+/**********************
+    Private functions
+**********************/
+void check(bool ok, const char *what) {
+	if (!ok) {
+		fprintf(stderr, "fuzz: %s\n", what);
+		abort();
+	}
+}
+
+void fuzzJsmn(uint16_t len) {
+	static jsmntok_t copy[JSMN_ARENA_SIZE];
+	jsmntok_t *tokens = jsmn_borrow();
+	jsmn_parser parser;
+	jsmn_init(&parser);
+	jsmnerr_t r = jsmn_parse(&parser, text, len, tokens, JSMN_ARENA_SIZE);
+	int16_t count = parser.toknext;
+	for (int16_t i = 0; i < count; i++) {
+		check(tokens[i].start <= len, "start out of bounds");
+		check(tokens[i].end == JSMN_NONE || (tokens[i].end <= len && tokens[i].start <= tokens[i].end), "end out of bounds");
+		check(tokens[i].skip >= 1 && i + tokens[i].skip <= count, "skip out of bounds");
+	}
+	memcpy(copy, tokens, count * sizeof(jsmntok_t));
+	// the same text as it arrives in a stream
+	jsmnerr_t r2 = JSMN_ERROR_PART;
+	jsmn_init(&parser);
+	for (uint16_t n = 1; n <= len && r2 == JSMN_ERROR_PART; n++) {
+		r2 = jsmn_parse(&parser, text, n, tokens, JSMN_ARENA_SIZE);
+	}
+	if (r == JSMN_SUCCESS && r2 == JSMN_SUCCESS) {
+		check(parser.toknext == count && memcmp(copy, tokens, count * sizeof(jsmntok_t)) == 0, "stream parse differs");
+	}
+	jsmn_return();
+}
+
+void fuzzHashTable() {
+	JsonParser<JSMN_ARENA_SIZE> parser;
+	JsonHashTable table = parser.parseHashTable(text);
+	if (!table.success()) {
+		return;
+	}
+	table.getLong("value");
+	table.getBool("active");
+	table.containsKey("rules");
+	JsonArray rules = table.getArray("rules");
+	for (int i = 0; i < rules.getLength(); i++) {
+		rules.getHashTable(i).getArray("actions").getLength();
+	}
+	table.getString("device");
+}
+
+void fuzzNumbers(uint16_t len) {
+	jsmntok_t tok = {0, len, JSMN_PRIMITIVE, 0, 1};
+	int32_t v32;
+	int16_t v16;
+	text[len] = 0;
+	// plain integers only, strtol is the reference
+	uint8_t neg = (text[0] == '-');
+	bool plain = (len > neg && len < 15 && strspn(text + neg, "0123456789") == len - neg);
+	long ref = strtol(text, NULL, 10);
+	bool ok = jsmn_int32(text, &tok, &v32);
+	check(ok == (plain && ref >= INT32_MIN && ref <= INT32_MAX), "int32 accepts");
+	check(!ok || v32 == ref, "int32 value");
+	ok = jsmn_int16(text, &tok, &v16);
+	check(ok == (plain && ref >= INT16_MIN && ref <= INT16_MAX), "int16 accepts");
+	check(!ok || v16 == ref, "int16 value");
+	tok.type = JSMN_STRING;
+	if (jsmn_minutes(text, &tok, &v16)) {
+		check(len == 5 && v16 == atoi(text) * 60 + atoi(text + 3) && atoi(text + 3) < 60, "minutes");
+	}
+}
+
+/*****************************************************************
+    Public functions (templates in the corresponding header-file)
+******************************************************************/
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	char error[BND_ERROR_SIZE];
+	JsonWriter jw;
+	if (!started) {
+		native_setup();
+		started = true;
+	}
+	if (size < 1 || size > FUZZ_TEXT_SIZE - 100) {
+		return 0; // room for an error message
+	}
+	uint16_t len = size - 1;
+	memcpy(text, data + 1, len);
+	text[len] = 0;
+	out.clear();
+	jw_init(&jw, &out, false, false);
+	switch (data[0] % FUZZ_TARGETS) {
+	case FUZZ_JSMN:
+		fuzzJsmn(len);
+		break;
+	case FUZZ_HASHTABLE:
+		fuzzHashTable();
+		break;
+	case FUZZ_RULESET:
+		rls_setRuleSetFromJson(len % NR_OF_RULESETS, text);
+		rls_getRuleSetAsJson(len % NR_OF_RULESETS, &jw);
+		rls_checkTempRules(now() + len * 60);
+		break;
+	case FUZZ_SPRAYER:
+		rls_setSprayerRuleFromJson(text);
+		rls_getSprayerRuleAsJson(&jw);
+		break;
+	case FUZZ_TIMER:
+		if (tmr_setTimerFromJson(text, error)) {
+			tmr_getTimersAsJson(0, &jw);
+		}
+		break;
+	case FUZZ_NUMBERS:
+		fuzzNumbers(len);
+		break;
+	}
+	jw_end(&jw);
+	return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+// Run the files that are given, or stdin (AFL)
+int main(int argc, char **argv) {
+	static uint8_t data[FUZZ_TEXT_SIZE];
+	if (argc == 1) {
+		size_t size = fread(data, 1, sizeof(data), stdin);
+		return LLVMFuzzerTestOneInput(data, size);
+	}
+	for (int i = 1; i < argc; i++) {
+		FILE *f = fopen(argv[i], "rb");
+		if (f == NULL) {
+			perror(argv[i]);
+			return 1;
+		}
+		size_t size = fread(data, 1, sizeof(data), f);
+		fclose(f);
+		LLVMFuzzerTestOneInput(data, size);
+	}
+	printf("%d inputs passed\n", argc - 1);
+	return 0;
+}
+#endif
@@ -0,0 +1,88 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 20-3-2021
+* File : Arduino.h
+* The part of the Arduino core the modules use, for the native
+* (Linux) test, fuzz and bench builds.
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*****************
+    Defines
+******************/
+#define LOW     0
+#define HIGH    1
+#define INPUT   0
+#define OUTPUT  1
+#define DEC    10
+#define HEX    16
+
+/*****************
+    Structs
+******************/
+typedef uint8_t byte;
+
+class Print {
+public:
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t *buf, size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			write(buf[i]);
+		}
+		return n;
+	}
+	size_t print(const char *s) {
+		return write((const uint8_t *)s, strlen(s));
+	}
+	size_t print(long value, int base = DEC) {
+		char tmp[12];
+		sprintf(tmp, base == HEX ? "%lX" : "%ld", value);
+		return print(tmp);
+	}
+	size_t print(int value, int base = DEC) {
+		return print((long)value, base);
+	}
+	size_t print(unsigned int value, int base = DEC) {
+		return print((long)value, base);
+	}
+	size_t println(const char *s = "") {
+		return print(s) + print("\r\n");
+	}
+	virtual void flush() {}
+};
+
+// Writes to stdout when native_trace is set
+class HardwareSerial : public Print {
+public:
+	void begin(long) {}
+	size_t write(uint8_t c);
+	using Print::write;
+};
+
+/*************************
+    Function templates
+*************************/
+extern HardwareSerial Serial1;
+extern bool native_trace;
+
+unsigned long millis();
+void delay(unsigned long ms);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+#endif /* NATIVE_ARDUINO_H */
@@ -0,0 +1,20 @@
+#ifndef NATIVE_DHT_H
+#define NATIVE_DHT_H
+// Native builds: the room values are native_roomTemp and native_roomHum
+
+extern float native_roomTemp;
+extern float native_roomHum;
+
+class DHT {
+public:
+	DHT(int) {}
+	void begin(int) {}
+	float readHumidity() {
+		return native_roomHum;
+	}
+	float readTemperature() {
+		return native_roomTemp;
+	}
+};
+
+#endif /* NATIVE_DHT_H */
@@ -0,0 +1,19 @@
+#ifndef NATIVE_DALLASTEMPERATURE_H
+#define NATIVE_DALLASTEMPERATURE_H
+// Native builds: the terrarium temperature is native_temp
+
+#include <OneWire.h>
+
+extern float native_temp;
+
+class DallasTemperature {
+public:
+	DallasTemperature(OneWire *) {}
+	void begin() {}
+	void requestTemperatures() {}
+	float getTempCByIndex(int) {
+		return native_temp;
+	}
+};
+
+#endif /* NATIVE_DALLASTEMPERATURE_H */
@@ -0,0 +1,52 @@
+#ifndef NATIVE_EEPROM_H
+#define NATIVE_EEPROM_H
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 20-3-2021
+* File : EEPROM.h
+* The 256 bytes EEPROM of the ATmega4809 in RAM.
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <stdint.h>
+#include <string.h>
+
+/*****************
+    Structs
+******************/
+class EEPROMClass {
+public:
+	uint8_t read(int address) {
+		return mem[address];
+	}
+	void write(int address, uint8_t value) {
+		mem[address] = value;
+	}
+	void update(int address, uint8_t value) {
+		mem[address] = value;
+	}
+	template <typename T> T &get(int address, T &t) {
+		memcpy(&t, mem + address, sizeof(T));
+		return t;
+	}
+	template <typename T> const T &put(int address, const T &t) {
+		memcpy(mem + address, &t, sizeof(T));
+		return t;
+	}
+	uint16_t length() {
+		return sizeof(mem);
+	}
+
+	uint8_t mem[256];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif /* NATIVE_EEPROM_H */
@@ -0,0 +1,10 @@
+#ifndef NATIVE_ONEWIRE_H
+#define NATIVE_ONEWIRE_H
+// Native builds: the bus is not used, DallasTemperature returns native_temp
+
+class OneWire {
+public:
+	OneWire(int) {}
+};
+
+#endif /* NATIVE_ONEWIRE_H */
@@ -0,0 +1,54 @@
+#ifndef NATIVE_TIMELIB_H
+#define NATIVE_TIMELIB_H
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 20-3-2021
+* File : TimeLib.h
+* The part of TimeLib the modules use, on top of the C library.
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <stdint.h>
+#include <time.h>
+
+/*****************
+    Defines
+******************/
+#define SECS_PER_DAY 86400UL
+
+/*****************
+    Structs
+******************/
+typedef struct {
+	uint8_t Second;
+	uint8_t Minute;
+	uint8_t Hour;
+	uint8_t Wday;   // day of week, sunday is day 1
+	uint8_t Day;
+	uint8_t Month;
+	uint8_t Year;   // offset from 1970
+} tmElements_t;
+
+/*************************
+    Function templates
+*************************/
+time_t now();
+void setTime(time_t t);
+int hour(time_t t);
+int minute(time_t t);
+int second(time_t t);
+int day(time_t t);
+int month(time_t t);
+int year(time_t t);
+int weekday(time_t t);
+time_t makeTime(const tmElements_t &tm);
+void breakTime(time_t t, tmElements_t &tm);
+
+#endif /* NATIVE_TIMELIB_H */
@@ -0,0 +1,147 @@
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 20-3-2021
+* File : native.cpp
+* Host side of the Arduino core, TimeLib, EEPROM and the sensors.
+* Time only moves when a test sets it.
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <Arduino.h>
+#include <DHT.h>
+#include <DallasTemperature.h>
+#include <EEPROM.h>
+#include <TimeLib.h>
+#include "MemoryFree.h"
+#include "arbiter.h"
+#include "eeprom.h"
+#include "native.h"
+#include "rules.h"
+#include "sensors.h"
+#include "terrarium.h"
+#include "timers.h"
+
+/*****************
+    Private data
+******************/
+HardwareSerial Serial1;
+EEPROMClass EEPROM;
+bool native_trace = false;
+float native_temp = 25.0;
+float native_roomTemp = 20.0;
+float native_roomHum = 55.0;
+unsigned long nativeMillis = 0;
+time_t nativeTime = 1609502400; // 01-01-2021 12:00
+
+/**********************
+    Private functions
+**********************/
+struct tm *native_tm(time_t t) {
+	static struct tm tm;
+	gmtime_r(&t, &tm);
+	return &tm;
+}
+
+/*****************************************************************
+    Public functions (templates in the corresponding header-file)
+******************************************************************/
+size_t HardwareSerial::write(uint8_t c) {
+	return native_trace ? fwrite(&c, 1, 1, stdout) : 1;
+}
+
+unsigned long millis() {
+	return nativeMillis;
+}
+
+void delay(unsigned long ms) {
+	nativeMillis += ms;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {}
+
+int freeMemory() {
+	return 0;
+}
+
+time_t now() {
+	return nativeTime;
+}
+
+void setTime(time_t t) {
+	nativeTime = t;
+}
+
+int hour(time_t t) {
+	return native_tm(t)->tm_hour;
+}
+
+int minute(time_t t) {
+	return native_tm(t)->tm_min;
+}
+
+int second(time_t t) {
+	return native_tm(t)->tm_sec;
+}
+
+int day(time_t t) {
+	return native_tm(t)->tm_mday;
+}
+
+int month(time_t t) {
+	return native_tm(t)->tm_mon + 1;
+}
+
+int year(time_t t) {
+	return native_tm(t)->tm_year + 1900;
+}
+
+int weekday(time_t t) {
+	return native_tm(t)->tm_wday + 1;
+}
+
+time_t makeTime(const tmElements_t &e) {
+	struct tm tm = {};
+	tm.tm_year = e.Year + 70;
+	tm.tm_mon = e.Month - 1;
+	tm.tm_mday = e.Day;
+	tm.tm_hour = e.Hour;
+	tm.tm_min = e.Minute;
+	tm.tm_sec = e.Second;
+	return timegm(&tm);
+}
+
+void breakTime(time_t t, tmElements_t &e) {
+	struct tm *tm = native_tm(t);
+	e.Year = tm->tm_year - 70;
+	e.Month = tm->tm_mon + 1;
+	e.Day = tm->tm_mday;
+	e.Hour = tm->tm_hour;
+	e.Minute = tm->tm_min;
+	e.Second = tm->tm_sec;
+	e.Wday = tm->tm_wday + 1;
+}
+
+void native_setup() {
+	gen_setTraceOn(false);
+	gen_setup();
+	sensors_init();
+	epr_init();
+	gen_initEEPROM();
+	tmr_initEEPROM();
+	rls_initEEPROM();
+	gen_init();
+	arb_init();
+	tmr_init();
+	rls_init();
+	arb_tick(0); // every test starts with all devices off
+	sensors_read();
+}
@@ -0,0 +1,65 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 20-3-2021
+* File : native.h
+* Helpers for the tests, fuzzers and benchmarks on the host.
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <Arduino.h>
+
+/*****************
+    Defines
+******************/
+#define NATIVE_OUTPUT_SIZE 2048
+
+/*****************
+    Structs
+******************/
+// Collects what is written, the text is always terminated
+class BufferPrint : public Print {
+public:
+	BufferPrint() {
+		clear();
+	}
+	void clear() {
+		len = 0;
+		text[0] = 0;
+	}
+	size_t write(uint8_t c) {
+		if (len < NATIVE_OUTPUT_SIZE - 1) {
+			text[len++] = c;
+			text[len] = 0;
+		}
+		return 1;
+	}
+	using Print::write;
+
+	char text[NATIVE_OUTPUT_SIZE];
+	uint16_t len;
+};
+
+/*************************
+    Function templates
+*************************/
+// What the sensors read, in degrees Celsius and %
+extern float native_temp;
+extern float native_roomTemp;
+extern float native_roomHum;
+
+/*
+* Initialize the modules like setup() does after a cleared EEPROM, without
+* the LCD, WiFi and REST server.
+*/
+void native_setup();
+
+#endif /* NATIVE_H */
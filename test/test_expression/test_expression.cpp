@@ -0,0 +1,126 @@
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 28-3-2021
+* File : test_expression.cpp
+* The expression compiler and its stack machine, run with: pio test -e native
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <string.h>
+#include <unity.h>
+#include "expression.h"
+
+/*****************
+    Private data
+******************/
+uint8_t code[1 + XPR_MAX_CODE];
+char text[XPR_MAX_TEXT + 1];
+// terrarium_temp, room_temp, room_hum, minute_of_day
+int16_t vars[XPR_NR_OF_VARS] = {29, 21, 55, 720};
+
+/**********************
+    Private functions
+**********************/
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+const char *compile(const char *s) {
+	return xpr_compile(s, strlen(s), code);
+}
+
+int16_t run(const char *s) {
+	TEST_ASSERT_NULL(compile(s));
+	TEST_ASSERT_TRUE(xpr_isValid(code + 1, code[0]));
+	return xpr_run(code + 1, code[0], vars);
+}
+
+void test_run(void) {
+	TEST_ASSERT_EQUAL(1, run("terrarium_temp > 28 && room_hum < 60 && minute_of_day in [600,1320]"));
+	TEST_ASSERT_EQUAL(0, run("terrarium_temp > 28 && room_hum < 50"));
+	TEST_ASSERT_EQUAL(1, run("room_hum < 50 || !(room_temp != 21)"));
+	TEST_ASSERT_EQUAL(1, run("minute_of_day >= 720 && minute_of_day <= -1 || 1"));
+	TEST_ASSERT_EQUAL(0, run("minute_of_day in [-200,719]"));
+	TEST_ASSERT_EQUAL(29, run("terrarium_temp"));
+}
+
+void test_bytecode(void) {
+	// a constant takes 1 byte when it fits in an int8_t, else 2
+	TEST_ASSERT_NULL(compile("room_hum < 60"));
+	const uint8_t small[] = {4, XPR_VAR + XPR_ROOM_HUM, XPR_CONST8, 60, XPR_LT};
+	TEST_ASSERT_EQUAL(0, memcmp(small, code, sizeof(small)));
+	TEST_ASSERT_NULL(compile("minute_of_day == 600"));
+	const uint8_t large[] = {5, XPR_VAR + XPR_MINUTE_OF_DAY, XPR_CONST16, 600 & 0xFF, 600 >> 8, XPR_EQ};
+	TEST_ASSERT_EQUAL(0, memcmp(large, code, sizeof(large)));
+	TEST_ASSERT_NULL(compile("  "));
+	TEST_ASSERT_EQUAL(0, code[0]);
+}
+
+void test_to_text(void) {
+	const char *texts[] = {
+		"terrarium_temp > 28 && room_hum < 60 && minute_of_day in [600,1320]",
+		"(room_hum < 50 || room_temp > 3) && !(terrarium_temp == -4)",
+		"room_hum < 50 || room_temp > 3 && terrarium_temp != 1000",
+		"(1 < 2) == 1",
+		"!!room_hum"
+	};
+	for (uint8_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+		TEST_ASSERT_NULL(compile(texts[i]));
+		xpr_toText(code + 1, code[0], text);
+		TEST_ASSERT_EQUAL_STRING(texts[i], text);
+	}
+	// spaces and parentheses that are not needed are not kept
+	TEST_ASSERT_NULL(compile("((room_hum)<60)&&(room_temp>=2)"));
+	xpr_toText(code + 1, code[0], text);
+	TEST_ASSERT_EQUAL_STRING("room_hum < 60 && room_temp >= 2", text);
+}
+
+void test_rejected(void) {
+	TEST_ASSERT_EQUAL_STRING("unknown name", compile("room_humidity < 60"));
+	TEST_ASSERT_EQUAL_STRING("syntax error", compile("room_hum < 60 &&"));
+	TEST_ASSERT_EQUAL_STRING("syntax error", compile("room_hum in [1 2]"));
+	TEST_ASSERT_EQUAL_STRING("syntax error", compile("(room_hum < 60"));
+	TEST_ASSERT_EQUAL_STRING("number out of range", compile("room_hum < 32768"));
+	TEST_ASSERT_EQUAL_STRING("expression too deep", compile("!!!!!!!!!room_hum"));
+	TEST_ASSERT_EQUAL_STRING("expression too deep", compile("1 || (2 || (3 || (4 || (5 || (6 || (7 || (8 || 9)))))))"));
+	TEST_ASSERT_EQUAL_STRING("expression too long",
+		compile("room_hum < 1000 && room_hum < 1000 && room_hum < 1000 && room_hum < 1000 && room_hum < 1000"));
+	// the text of 8 names is too long, their bytecode is not
+	TEST_ASSERT_EQUAL_STRING("expression too long",
+		compile("minute_of_day || minute_of_day || minute_of_day || minute_of_day || minute_of_day || minute_of_day"
+			" || minute_of_day || minute_of_day"));
+}
+
+void test_invalid_bytecode(void) {
+	const uint8_t twoValues[] = {XPR_VAR, XPR_VAR};
+	const uint8_t noOperand[] = {XPR_VAR, XPR_AND};
+	const uint8_t cutOff[] = {XPR_CONST16, 1};
+	const uint8_t unknown[] = {XPR_VAR + XPR_NR_OF_VARS};
+	TEST_ASSERT_FALSE(xpr_isValid(twoValues, sizeof(twoValues)));
+	TEST_ASSERT_FALSE(xpr_isValid(noOperand, sizeof(noOperand)));
+	TEST_ASSERT_FALSE(xpr_isValid(cutOff, sizeof(cutOff)));
+	TEST_ASSERT_FALSE(xpr_isValid(unknown, sizeof(unknown)));
+	TEST_ASSERT_FALSE(xpr_isValid(code, 0));
+}
+
+/*****************************************************************
+    Public functions (templates in the corresponding header-file)
+******************************************************************/
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_run);
+	RUN_TEST(test_bytecode);
+	RUN_TEST(test_to_text);
+	RUN_TEST(test_rejected);
+	RUN_TEST(test_invalid_bytecode);
+	return UNITY_END();
+}
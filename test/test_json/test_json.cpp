@@ -0,0 +1,181 @@
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 20-3-2021
+* File : test_json.cpp
+* jsmn, the typed token parsers and JsonParser, run with: pio test -e native
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <string.h>
+#include <unity.h>
+#include <JsonParser.h>
+#include "utility/jsmn.h"
+
+/*****************
+    Private data
+******************/
+jsmn_parser parser;
+jsmntok_t *tokens;
+char text[32];
+
+/**********************
+    Private functions
+**********************/
+jsmnerr_t parse(const char *json) {
+	jsmn_init(&parser);
+	return jsmn_parse(&parser, json, strlen(json), tokens, JSMN_ARENA_SIZE);
+}
+
+// The token of a value that is parsed as the element of an array, in text
+jsmntok_t *element(const char *value) {
+	sprintf(text, "[%s]", value);
+	TEST_ASSERT_EQUAL(JSMN_SUCCESS, parse(text));
+	return &tokens[1];
+}
+
+void setUp(void) {
+	tokens = jsmn_borrow();
+}
+
+void tearDown(void) {
+	jsmn_return();
+}
+
+void test_stops_after_first_value(void) {
+	const char *json = "{\"a\":1} {\"b\":2}";
+	TEST_ASSERT_EQUAL(JSMN_SUCCESS, parse(json));
+	TEST_ASSERT_EQUAL(7, parser.pos);
+	TEST_ASSERT_EQUAL(3, parser.toknext);
+	TEST_ASSERT_EQUAL(JSMN_SUCCESS, parse("\"a\" 1"));
+	TEST_ASSERT_EQUAL(3, parser.pos);
+	TEST_ASSERT_EQUAL(JSMN_ERROR_PART, parse(" ,"));
+}
+
+void test_resumes_when_more_arrives(void) {
+	const char *json = "{\"timers\":[1,22,333]}";
+	jsmn_init(&parser);
+	for (unsigned int len = 1; len < strlen(json); len++) {
+		TEST_ASSERT_EQUAL(JSMN_ERROR_PART, jsmn_parse(&parser, json, len, tokens, JSMN_ARENA_SIZE));
+	}
+	TEST_ASSERT_EQUAL(JSMN_SUCCESS, jsmn_parse(&parser, json, strlen(json), tokens, JSMN_ARENA_SIZE));
+	TEST_ASSERT_EQUAL(6, parser.toknext);
+	TEST_ASSERT_EQUAL(3, tokens[2].size);
+	TEST_ASSERT_EQUAL(13, tokens[4].start);
+	TEST_ASSERT_EQUAL(15, tokens[4].end);
+}
+
+void test_skip_counts_nested_tokens(void) {
+	TEST_ASSERT_EQUAL(JSMN_SUCCESS, parse("[{\"a\":[1,2]},3]"));
+	TEST_ASSERT_EQUAL(7, tokens[0].skip);
+	TEST_ASSERT_EQUAL(5, tokens[1].skip);
+	TEST_ASSERT_EQUAL(3, tokens[3].skip);
+	TEST_ASSERT_EQUAL(1, tokens[6].skip);
+}
+
+void test_too_many_tokens(void) {
+	char json[2 * JSMN_ARENA_SIZE + 4] = "[";
+	for (int i = 0; i < JSMN_ARENA_SIZE; i++) {
+		strcat(json, "0,");
+	}
+	strcat(json, "0]");
+	TEST_ASSERT_EQUAL(JSMN_ERROR_NOMEM, parse(json));
+}
+
+void test_arena_has_one_borrower(void) {
+	TEST_ASSERT_NULL(jsmn_borrow());
+	JsonParser<8> other;
+	char json[] = "{\"a\":1}";
+	TEST_ASSERT_FALSE(other.parseHashTable(json).success());
+}
+
+void test_int16(void) {
+	int16_t v = 7;
+	TEST_ASSERT_TRUE(jsmn_int16(text, element("32767"), &v));
+	TEST_ASSERT_EQUAL(32767, v);
+	TEST_ASSERT_TRUE(jsmn_int16(text, element("-32768"), &v));
+	TEST_ASSERT_EQUAL(-32768, v);
+	TEST_ASSERT_TRUE(jsmn_int16(text, element("007"), &v));
+	TEST_ASSERT_EQUAL(7, v);
+	const char *bad[] = {"32768", "-32769", "1.5", "1e3", "+1", "-", "true", "0x10", "99999999999"};
+	for (uint8_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		v = 7;
+		TEST_ASSERT_FALSE_MESSAGE(jsmn_int16(text, element(bad[i]), &v), bad[i]);
+		TEST_ASSERT_EQUAL(7, v);
+	}
+	TEST_ASSERT_FALSE(jsmn_int16(text, element("\"12\""), &v));
+}
+
+void test_int8_and_int32(void) {
+	int8_t v8;
+	int32_t v32;
+	TEST_ASSERT_TRUE(jsmn_int8(text, element("-128"), &v8));
+	TEST_ASSERT_EQUAL(-128, v8);
+	TEST_ASSERT_FALSE(jsmn_int8(text, element("128"), &v8));
+	TEST_ASSERT_TRUE(jsmn_int32(text, element("2147483647"), &v32));
+	TEST_ASSERT_EQUAL_INT32(2147483647L, v32);
+	TEST_ASSERT_TRUE(jsmn_int32(text, element("-2147483648"), &v32));
+	TEST_ASSERT_EQUAL_INT32(-2147483647L - 1, v32);
+	TEST_ASSERT_FALSE(jsmn_int32(text, element("2147483648"), &v32));
+	TEST_ASSERT_FALSE(jsmn_int32(text, element("-2147483649"), &v32));
+}
+
+void test_minutes(void) {
+	int16_t v;
+	const char *json = "[\"00:00\",\"23:59\",\"10:60\",\"1:00\",\"ab:cd\",\"25:00\",1200]";
+	TEST_ASSERT_EQUAL(JSMN_SUCCESS, parse(json));
+	TEST_ASSERT_TRUE(jsmn_minutes(json, &tokens[1], &v));
+	TEST_ASSERT_EQUAL(0, v);
+	TEST_ASSERT_TRUE(jsmn_minutes(json, &tokens[2], &v));
+	TEST_ASSERT_EQUAL(1439, v);
+	TEST_ASSERT_FALSE(jsmn_minutes(json, &tokens[3], &v));
+	TEST_ASSERT_FALSE(jsmn_minutes(json, &tokens[4], &v));
+	TEST_ASSERT_FALSE(jsmn_minutes(json, &tokens[5], &v));
+	TEST_ASSERT_TRUE(jsmn_minutes(json, &tokens[6], &v)); // the caller checks the range
+	TEST_ASSERT_EQUAL(1500, v);
+	TEST_ASSERT_FALSE(jsmn_minutes(json, &tokens[7], &v));
+}
+
+void test_hashtable_keeps_the_text(void) {
+	jsmn_return();
+	char json[] = "{\"unixtime\":1609502400,\"nested\":{\"unixtime\":1},\"utc_offset\":\"+01:00\",\"ok\":true}";
+	char copy[sizeof(json)];
+	strcpy(copy, json);
+	{
+		JsonParser<16> p;
+		JsonHashTable tm = p.parseHashTable(json);
+		TEST_ASSERT_TRUE(tm.success());
+		TEST_ASSERT_EQUAL_INT32(1609502400L, tm.getLong("unixtime"));
+		TEST_ASSERT_TRUE(tm.getBool("ok"));
+		TEST_ASSERT_FALSE(tm.containsKey("unix"));
+		TEST_ASSERT_FALSE(tm.containsKey("unixtimes"));
+		TEST_ASSERT_EQUAL(1, tm.getHashTable("nested").getLong("unixtime"));
+		TEST_ASSERT_EQUAL_STRING(copy, json); // lookups do not terminate keys
+		TEST_ASSERT_EQUAL_STRING("+01:00", tm.getString("utc_offset"));
+	}
+	tokens = jsmn_borrow(); // the parser has given the arena back
+	TEST_ASSERT_NOT_NULL(tokens);
+}
+
+/*****************************************************************
+    Public functions (templates in the corresponding header-file)
+******************************************************************/
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_stops_after_first_value);
+	RUN_TEST(test_resumes_when_more_arrives);
+	RUN_TEST(test_skip_counts_nested_tokens);
+	RUN_TEST(test_too_many_tokens);
+	RUN_TEST(test_arena_has_one_borrower);
+	RUN_TEST(test_int16);
+	RUN_TEST(test_int8_and_int32);
+	RUN_TEST(test_minutes);
+	RUN_TEST(test_hashtable_keeps_the_text);
+	return UNITY_END();
+}
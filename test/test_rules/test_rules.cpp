@@ -0,0 +1,645 @@
+/**************************************************************
+*
+* Copyright © 2021 Dutch Arrow Software - All Rights Reserved
+* You may use, distribute and modify this code under the
+* terms of the Apache Software License 2.0.
+*
+* Author : Tom Pijl
+* Created On : 20-3-2021
+* File : test_rules.cpp
+* The JSON setters and the temperature rules, run with: pio test -e native
+***************************************************************/
+
+/*****************
+    Includes
+******************/
+#include <string.h>
+#include <unity.h>
+#include <EEPROM.h>
+#include "arbiter.h"
+#include "binder.h"
+#include "eeprom.h"
+#include "jsonwriter.h"
+#include "native.h"
+#include "rules.h"
+#include "sensors.h"
+#include "terrarium.h"
+#include "timers.h"
+
+/*****************
+    Private data
+******************/
+const char *ruleset =
+	"{\"terrarium\":1,\"active\":\"yes\",\"from\":\"00:00\",\"to\":\"23:59\",\"temp_ideal\":25,\"rules\":["
+	"{\"value\":28,\"actions\":[{\"device\":\"fan_in\",\"on_period\":-2},{\"device\":\"fan_out\",\"on_period\":-2},"
+	"{\"device\":\"no device\",\"on_period\":0},{\"device\":\"no device\",\"on_period\":0}]},"
+	"{\"value\":-20,\"actions\":[{\"device\":\"light2\",\"on_period\":-2},{\"device\":\"no device\",\"on_period\":0},"
+	"{\"device\":\"no device\",\"on_period\":0},{\"device\":\"no device\",\"on_period\":0}]}]}";
+// As it is stored, without the rules and actions that do nothing
+const char *rulesetStored =
+	"{\"terrarium\":1,\"active\":\"yes\",\"from\":\"00:00\",\"to\":\"23:59\",\"temp_ideal\":25,\"rules\":["
+	"{\"value\":28,\"actions\":[{\"device\":\"fan_in\",\"on_period\":-2},{\"device\":\"fan_out\",\"on_period\":-2}]},"
+	"{\"value\":-20,\"actions\":[{\"device\":\"light2\",\"on_period\":-2}]}]}";
+// 13 bytes stored
+const char *window =
+	"{\"terrarium\":1,\"active\":\"yes\",\"from\":\"08:00\",\"to\":\"10:00\",\"temp_ideal\":25,\"rules\":["
+	"{\"value\":28,\"actions\":[{\"device\":\"fan_in\",\"on_period\":-2}]}]}";
+const char *sprayerRule =
+	"{\"delay\":15,\"actions\":[{\"device\":\"fan_in\",\"on_period\":900},{\"device\":\"fan_out\",\"on_period\":900},"
+	"{\"device\":\"no device\",\"on_period\":0},{\"device\":\"no device\",\"on_period\":0}]}";
+char json[1300];
+BufferPrint out;
+JsonWriter jw;
+
+/**********************
+    Private functions
+**********************/
+void setUp(void) {
+	native_setup();
+	out.clear();
+	jw_init(&jw, &out, false, false);
+}
+
+void tearDown(void) {
+}
+
+// One tick of the loop: the rules request and the arbiter switches
+void tick(time_t curtime) {
+	rls_checkTempRules(curtime);
+	arb_tick(curtime);
+}
+
+// The temperature in the terrarium is temp, the rules are checked at 12:00
+void checkAt(float temp) {
+	native_temp = temp;
+	sensors_read();
+	tick(1609502400); // 01-01-2021 12:00
+}
+
+void test_ruleset_round_trip(void) {
+	strcpy(json, ruleset);
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("", json);
+	rls_getRuleSetAsJson(0, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_EQUAL_STRING(rulesetStored, out.text);
+}
+
+void test_ruleset_put_replaces_arrays(void) {
+	strcpy(json, ruleset);
+	rls_setRuleSetFromJson(0, json);
+	// what GET gives without fan_out and without the second rule
+	const char *fewer =
+		"{\"terrarium\":1,\"active\":\"yes\",\"from\":\"00:00\",\"to\":\"23:59\",\"temp_ideal\":25,\"rules\":["
+		"{\"value\":28,\"actions\":[{\"device\":\"fan_in\",\"on_period\":-2}]}]}";
+	strcpy(json, fewer);
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("", json);
+	rls_getRuleSetAsJson(0, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_EQUAL_STRING(fewer, out.text);
+	// the members that are not sent keep their value
+	strcpy(json, "{\"active\":\"no\"}");
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("", json);
+	out.clear();
+	jw_init(&jw, &out, false, false);
+	rls_getRuleSetAsJson(0, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_NOT_NULL(strstr(out.text, "\"actions\":[{\"device\":\"fan_in\""));
+}
+
+void test_rulesets_share_eeprom(void) {
+	for (int8_t setnr = 0; setnr < 5; setnr++) {
+		strcpy(json, window);
+		rls_setRuleSetFromJson(setnr, json);
+		TEST_ASSERT_EQUAL_STRING("", json);
+	}
+	strcpy(json, window);
+	rls_setRuleSetFromJson(5, json);
+	TEST_ASSERT_EQUAL_STRING("{\"error_msg\":\"The rulesets do not fit in EEPROM\"}", json);
+	// Removing the rule of set 2 makes room for a set without rules
+	strcpy(json, "{\"rules\":[{\"value\":0}]}");
+	rls_setRuleSetFromJson(1, json);
+	const char *noRules = "{\"terrarium\":1,\"active\":\"no\",\"from\":\"20:00\",\"to\":\"22:00\",\"temp_ideal\":25,\"rules\":[]}";
+	strcpy(json, noRules);
+	rls_setRuleSetFromJson(5, json);
+	TEST_ASSERT_EQUAL_STRING("", json);
+	rls_init(); // read back from EEPROM
+	rls_getRuleSetAsJson(5, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_EQUAL_STRING(noRules, out.text);
+	out.clear();
+	jw_init(&jw, &out, false, false);
+	rls_getRuleSetAsJson(4, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_EQUAL_STRING(window, out.text);
+	out.clear();
+	jw_init(&jw, &out, false, false);
+	rls_getRuleSetAsJson(1, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_NOT_NULL(strstr(out.text, "\"rules\":[]"));
+}
+
+void test_ruleset_rejected(void) {
+	rls_getRuleSetAsJson(1, &jw);
+	jw_end(&jw);
+	char before[NATIVE_OUTPUT_SIZE];
+	strcpy(before, out.text);
+	strcpy(json, ruleset);
+	memcpy(strstr(json, "light2"), "light9", 6);
+	rls_setRuleSetFromJson(1, json);
+	TEST_ASSERT_EQUAL_STRING("{\"error_msg\":\"rules[1].actions[0].device: unknown device\"}", json);
+	out.clear();
+	jw_init(&jw, &out, false, false);
+	rls_getRuleSetAsJson(1, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_EQUAL_STRING(before, out.text);
+}
+
+void test_sprayer_rule_round_trip(void) {
+	strcpy(json, sprayerRule);
+	rls_setSprayerRuleFromJson(json);
+	rls_getSprayerRuleAsJson(&jw);
+	jw_end(&jw);
+	TEST_ASSERT_EQUAL_STRING(sprayerRule, out.text);
+}
+
+void test_rulesets_of_older_layout(void) {
+	// an older layout left its count and start address of the rulesets
+	EEPROM.write(2, 2);
+	EEPROM.write(3, 167);
+	epr_setHoursOn(1000);
+	strcpy(json, sprayerRule);
+	rls_setSprayerRuleFromJson(json);
+	rls_init();
+	TEST_ASSERT_EQUAL(EPR_ADDRESS_RULESETS, EEPROM.read(3));
+	for (int8_t setnr = 0; setnr < NR_OF_RULESETS; setnr++) {
+		strcpy(json, window);
+		rls_setRuleSetFromJson(setnr, json);
+	}
+	TEST_ASSERT_EQUAL(1000, epr_getHoursOn());
+	rls_init();
+	rls_getSprayerRuleAsJson(&jw);
+	jw_end(&jw);
+	TEST_ASSERT_EQUAL_STRING(sprayerRule, out.text);
+}
+
+void test_timer(void) {
+	char error[BND_ERROR_SIZE];
+	strcpy(json, "{\"device\":\"light1\",\"index\":1,\"hour_on\":9,\"minute_on\":30,\"hour_off\":21,\"minute_off\":0,\"repeat\":1,\"period\":0}");
+	TEST_ASSERT_TRUE(tmr_setTimerFromJson(json, error));
+	tmr_getTimerAsJson(LIGHT1, 1, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_EQUAL_STRING(json, out.text);
+	strcpy(json, "{\"device\":\"light1\",\"index\":9,\"hour_on\":9,\"minute_on\":30,\"hour_off\":21,\"minute_off\":0,\"repeat\":1,\"period\":0}");
+	TEST_ASSERT_FALSE(tmr_setTimerFromJson(json, error));
+	strcpy(json, "{\"device\":\"light1\",\"index\":1,\"hour_on\":24}");
+	TEST_ASSERT_FALSE(tmr_setTimerFromJson(json, error));
+	TEST_ASSERT_EQUAL_STRING("hour_on: out of range", error);
+	// the sprayer has the last 3 slots
+	out.clear();
+	jw_init(&jw, &out, false, false);
+	tmr_getTimersAsJson(SPRAYER, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_NOT_NULL(strstr(out.text, "\"index\":3"));
+	TEST_ASSERT_NULL(strstr(out.text, "\"index\":4"));
+	TEST_ASSERT_NULL(strstr(out.text, "light1"));
+	tmr_check(1609502400); // 12:00
+	arb_tick(1609502400);
+	TEST_ASSERT_EQUAL(ARB_TIMER, gen_getSource(LIGHT1));
+	tmr_check(1609502400 + 10 * 3600); // 22:00
+	arb_tick(1609502400 + 10 * 3600);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(LIGHT1));
+}
+
+// Timer i of the sprayer from on to off, a period > 0 makes it a pulse at on
+void sprayerTimer(int8_t i, const char *on, const char *off, int16_t period) {
+	char error[BND_ERROR_SIZE];
+	sprintf(json, "{\"device\":\"sprayer\",\"index\":%d,\"hour_on\":%.2s,\"minute_on\":%s,\"hour_off\":%.2s,"
+		"\"minute_off\":%s,\"repeat\":1,\"period\":%d}", i, on, on + 3, off, off + 3, period);
+	TEST_ASSERT_TRUE(tmr_setTimerFromJson(json, error));
+}
+
+void test_timers_of_older_layout(void) {
+	char error[BND_ERROR_SIZE];
+	// 9 byte timers with their period and repeat where phase and weekdays are now
+	for (uint8_t i = 0; i < 12; i++) {
+		uint8_t old[9] = {(uint8_t)(i < 3 ? i : 3 + (i - 3) / 3), (uint8_t)(i < 3 ? 1 : 1 + (i - 3) % 3), 0, 0, 0, 0, 0, 0, 1};
+		memcpy(EEPROM.mem + EPR_ADDRESS_TIMERS + 9 * i, old, sizeof(old));
+	}
+	tmr_init();
+	strcpy(json, "{\"device\":\"fan_in\",\"index\":1,\"hour_on\":9,\"hour_off\":10}");
+	TEST_ASSERT_TRUE(tmr_setTimerFromJson(json, error));
+	tmr_init(); // read back from EEPROM
+	tmr_getTimerAsJson(FAN_IN, 1, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_EQUAL_STRING("{\"device\":\"fan_in\",\"index\":1,\"hour_on\":9,\"minute_on\":0,\"hour_off\":10,"
+		"\"minute_off\":0,\"repeat\":1,\"period\":0}", out.text);
+}
+
+void test_timer_events(void) {
+	time_t midnight = 1609459200; // 01-01-2021 00:00
+	sprayerTimer(1, "10:00", "11:00", 0);
+	sprayerTimer(2, "11:00", "12:00", 0);
+	sprayerTimer(3, "13:00", "13:00", 60);
+	tmr_check(midnight + 10 * 3600);
+	arb_tick(midnight + 10 * 3600);
+	TEST_ASSERT_EQUAL(-1, gen_getDevices()[SPRAYER].end_time);
+	uint16_t version = arb_getVersion();
+	// the second window opens when the first one closes, the sprayer stays on
+	tmr_check(midnight + 11 * 3600);
+	arb_tick(midnight + 11 * 3600);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(SPRAYER));
+	TEST_ASSERT_EQUAL(version + 2, arb_getVersion());
+	tmr_check(midnight + 12 * 3600);
+	arb_tick(midnight + 12 * 3600);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(SPRAYER));
+	// the pulse
+	tmr_check(midnight + 13 * 3600 + 5);
+	arb_tick(midnight + 13 * 3600 + 5);
+	TEST_ASSERT_EQUAL(midnight + 13 * 3600 + 65, gen_getDevices()[SPRAYER].end_time);
+	arb_tick(midnight + 13 * 3600 + 66);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(SPRAYER));
+	// the next day it starts again, in the middle of a window
+	tmr_check(midnight + 86400 + 10 * 3600 + 1800);
+	arb_tick(midnight + 86400 + 10 * 3600 + 1800);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(SPRAYER));
+	// a changed timer is in effect at once
+	sprayerTimer(1, "09:00", "10:00", 0);
+	tmr_check(midnight + 86400 + 10 * 3600 + 1860);
+	arb_tick(midnight + 86400 + 10 * 3600 + 1860);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(SPRAYER));
+}
+
+void test_timer_put_after_pulse(void) {
+	time_t pulse = 1609459200 + 13 * 3600; // 01-01-2021 13:00
+	sprayerTimer(1, "13:00", "13:00", 30);
+	tmr_check(pulse);
+	arb_tick(pulse);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(SPRAYER));
+	arb_tick(pulse + 31);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(SPRAYER));
+	// another timer is changed in the same minute, the pulse does not fire again
+	sprayerTimer(2, "15:00", "16:00", 0);
+	tmr_check(pulse + 40);
+	arb_tick(pulse + 40);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(SPRAYER));
+	// a timer that opens later in the minute still fires
+	sprayerTimer(3, "13:01", "13:02", 0);
+	tmr_check(pulse + 60);
+	arb_tick(pulse + 60);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(SPRAYER));
+}
+
+void test_timer_recurrence(void) {
+	char error[BND_ERROR_SIZE];
+	time_t friday = 1609459200; // 01-01-2021 00:00, the day the timers are set
+	// every other day from today and on mondays and wednesdays
+	strcpy(json, "{\"device\":\"sprayer\",\"index\":1,\"hour_on\":10,\"hour_off\":11,\"repeat\":2}");
+	TEST_ASSERT_TRUE(tmr_setTimerFromJson(json, error));
+	strcpy(json, "{\"device\":\"fan_in\",\"index\":1,\"hour_on\":10,\"hour_off\":11,\"repeat\":1,\"days\":\"mon,wed\"}");
+	TEST_ASSERT_TRUE(tmr_setTimerFromJson(json, error));
+	tmr_getTimerAsJson(FAN_IN, 1, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_EQUAL_STRING("{\"device\":\"fan_in\",\"index\":1,\"hour_on\":10,\"minute_on\":0,\"hour_off\":11,\"minute_off\":0,"
+		"\"repeat\":1,\"days\":\"mon,wed\",\"period\":0}", out.text);
+	const bool sprayer[] = {true, false, true, false, true, false, true};  // fri - thu
+	const bool fanIn[] = {false, false, false, true, false, true, false};
+	for (uint8_t d = 0; d < 7; d++) {
+		time_t t = friday + d * 86400L + 10 * 3600 + 1800;
+		tmr_check(t);
+		arb_tick(t);
+		TEST_ASSERT_EQUAL(sprayer[d], gen_isDeviceOn(SPRAYER));
+		TEST_ASSERT_EQUAL(fanIn[d], gen_isDeviceOn(FAN_IN));
+		tmr_check(t + 3600);
+		arb_tick(t + 3600);
+		TEST_ASSERT_FALSE(gen_isDeviceOn(SPRAYER));
+	}
+	strcpy(json, "{\"device\":\"fan_in\",\"index\":1,\"days\":\"mon,someday\"}");
+	TEST_ASSERT_FALSE(tmr_setTimerFromJson(json, error));
+	TEST_ASSERT_EQUAL_STRING("days: unknown value", error);
+	strcpy(json, "{\"device\":\"fan_in\",\"index\":1,\"days\":\"\"}");
+	TEST_ASSERT_FALSE(tmr_setTimerFromJson(json, error));
+	TEST_ASSERT_EQUAL_STRING("days: out of range", error);
+}
+
+void test_cbor_tags(void) {
+	// a tag is skipped, however many there are, {"a": tag(1, [1])}
+	static uint8_t cbor[1300];
+	const uint8_t start[] = {0xA1, 0x61, 'a'};
+	memcpy(cbor, start, sizeof(start));
+	memset(cbor + sizeof(start), 0xC1, sizeof(cbor) - sizeof(start) - 2);
+	cbor[sizeof(cbor) - 2] = 0x81;
+	cbor[sizeof(cbor) - 1] = 0x01;
+	const uint8_t *p = cbor;
+	TEST_ASSERT_TRUE(jw_fromCbor(&jw, &p, cbor + sizeof(cbor)));
+	jw_end(&jw);
+	TEST_ASSERT_EQUAL_STRING("{\"a\":[1]}", out.text);
+	// a tag without content
+	p = cbor + sizeof(start);
+	TEST_ASSERT_FALSE(jw_fromCbor(&jw, &p, cbor + sizeof(cbor) - 2));
+}
+
+// The CBOR media type found in a header line, however long
+bool acceptsCbor(const char *line) {
+	uint8_t matched = 0;
+	for (const char *c = line; *c != 0; c++) {
+		matched = jw_matchCborType(matched, *c);
+	}
+	return matched == JW_CBOR_MATCHED;
+}
+
+void test_cbor_media_type(void) {
+	TEST_ASSERT_TRUE(acceptsCbor("Accept: application/json, application/cbor"));
+	TEST_ASSERT_TRUE(acceptsCbor("Content-Type: application/cbor"));
+	TEST_ASSERT_TRUE(acceptsCbor("Accept: applicapplication/cbor;q=0.9"));
+	TEST_ASSERT_FALSE(acceptsCbor("Accept: application/json, application/cb"));
+	TEST_ASSERT_FALSE(acceptsCbor("Accept: application/json"));
+}
+
+void test_temperature_rules(void) {
+	strcpy(json, ruleset);
+	rls_setRuleSetFromJson(0, json);
+	checkAt(27);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_IN));
+	checkAt(29);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(FAN_IN));
+	TEST_ASSERT_TRUE(gen_isDeviceOn(FAN_OUT));
+	TEST_ASSERT_FALSE(gen_isDeviceOn(LIGHT2));
+	checkAt(26);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(FAN_IN)); // until the ideal temperature
+	checkAt(25);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_IN));
+	checkAt(19);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(LIGHT2));
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_IN));
+}
+
+void test_rules_follow_changes(void) {
+	strcpy(json, ruleset);
+	rls_setRuleSetFromJson(0, json);
+	checkAt(29);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(FAN_IN));
+	arb_request(ARB_MANUAL, FAN_IN, 0); // switched off by hand
+	tick(1609502400);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_IN));
+	arb_release(ARB_MANUAL, FAN_IN); // and back to auto
+	tick(1609502400);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(FAN_IN));
+	tick(1609502400 + 11 * 3600 + 59 * 60); // 23:59, the window is closed
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_IN));
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_OUT));
+}
+
+void test_ruleset_put_releases_rules(void) {
+	strcpy(json, ruleset);
+	rls_setRuleSetFromJson(0, json);
+	checkAt(29);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(FAN_IN));
+	// deactivated, nothing keeps fan_in on until the ideal temperature
+	strcpy(json, "{\"active\":\"no\"}");
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("", json);
+	checkAt(20);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_IN));
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_OUT));
+	// replaced by rules for other devices
+	strcpy(json, ruleset);
+	rls_setRuleSetFromJson(0, json);
+	checkAt(29);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(FAN_IN));
+	strcpy(json, window);
+	strcpy(strstr(json, "fan_in"), "light1\",\"on_period\":-2}]}]}");
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("", json);
+	checkAt(29);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_IN));
+}
+
+void test_hysteresis_rule(void) {
+	strcpy(json, window);
+	strcpy(strstr(json, "\"actions\""), "\"kind\":\"hysteresis\",\"band\":2,\"actions\":[{\"device\":\"fan_in\",\"on_period\":-2}]}]}");
+	memcpy(strstr(json, "08:00"), "00:00", 5);
+	memcpy(strstr(json, "10:00"), "23:59", 5);
+	char stored[300];
+	strcpy(stored, json);
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("", json);
+	rls_getRuleSetAsJson(0, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_EQUAL_STRING(stored, out.text);
+	checkAt(29);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(FAN_IN));
+	checkAt(27);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(FAN_IN)); // inside the band
+	checkAt(26);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_IN));
+	strcpy(json, "{\"rules\":[{\"value\":28,\"kind\":\"rate\"}]}");
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("{\"error_msg\":\"rules[0].minutes: needed by a rate rule\"}", json);
+}
+
+void test_rate_rule(void) {
+	strcpy(json, ruleset);
+	strcpy(strstr(json, "\"rules\""), "\"rules\":[{\"value\":2,\"kind\":\"rate\",\"minutes\":2,\"actions\":[{\"device\":\"fan_out\",\"on_period\":-2}]}]}");
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("", json);
+	int8_t temps[] = {25, 25, 25, 26, 27, 27, 27};
+	bool on[] = {false, false, false, false, true, true, false};
+	for (int8_t m = 0; m < 7; m++) {
+		native_temp = temps[m];
+		sensors_read();
+		tick(1609502400 + m * 60);
+		TEST_ASSERT_EQUAL(on[m], gen_isDeviceOn(FAN_OUT));
+	}
+}
+
+void test_rule_params_of_eeprom(void) {
+	strcpy(json, ruleset);
+	strcpy(strstr(json, "\"rules\""), "\"rules\":[{\"value\":2,\"kind\":\"rate\",\"minutes\":2,\"actions\":[{\"device\":\"fan_out\",\"on_period\":-2}]}]}");
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("", json);
+	// the minutes follow the 8 bytes of the set and the 2 of the rule
+	TEST_ASSERT_EQUAL(2, EEPROM.read(EPR_ADDRESS_RULESETS + 10));
+	EEPROM.write(EPR_ADDRESS_RULESETS + 10, 100);
+	rls_init();
+	tick(1609502400);
+	rls_getRuleSetAsJson(0, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_NOT_NULL(strstr(out.text, "\"rules\":[]"));
+}
+
+void test_pid_rule(void) {
+	strcpy(json, ruleset);
+	strcpy(strstr(json, "\"rules\""), "\"rules\":[{\"value\":28,\"kind\":\"pid\",\"kp\":20,\"ki\":5,\"kd\":0,\"actions\":[{\"device\":\"fan_in\",\"on_period\":-2}]}]}");
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("", json);
+	checkAt(30); // error 2: 20 * 2 + 5 * 2 = 50% of the window
+	TEST_ASSERT_EQUAL(1609502400 + RLS_PID_WINDOW / 2, gen_getEndTime(FAN_IN));
+	tick(1609502400 + 60); // not a new window
+	TEST_ASSERT_EQUAL(1609502400 + RLS_PID_WINDOW / 2, gen_getEndTime(FAN_IN));
+	tick(1609502400 + RLS_PID_WINDOW / 2 + 1);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_IN));
+	tick(1609502400 + RLS_PID_WINDOW); // error 2 again: 40% + 5 * 4 = 60%
+	TEST_ASSERT_EQUAL(1609502400 + RLS_PID_WINDOW + RLS_PID_WINDOW * 6 / 10, gen_getEndTime(FAN_IN));
+}
+
+void test_expr_rule(void) {
+	strcpy(json, ruleset);
+	strcpy(strstr(json, "\"rules\""), "\"rules\":[{\"kind\":\"expr\",\"expr\":\"terrarium_temp>28 && (room_hum<60)\","
+		"\"actions\":[{\"device\":\"fan_in\",\"on_period\":-2}]}]}");
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("", json);
+	rls_getRuleSetAsJson(0, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_NOT_NULL(strstr(out.text, "{\"kind\":\"expr\",\"expr\":\"terrarium_temp > 28 && room_hum < 60\",\"actions\""));
+	native_roomHum = 50;
+	checkAt(30);
+	TEST_ASSERT_TRUE(gen_isDeviceOn(FAN_IN));
+	native_roomHum = 70; // only the humidity changes
+	checkAt(30);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_IN));
+	// an expression that does not compile is rejected, an empty one removes the rule
+	strcpy(json, "{\"rules\":[{\"kind\":\"expr\",\"expr\":\"room_hum <\"}]}");
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("{\"error_msg\":\"rules[0].expr: syntax error\"}", json);
+	// 257 characters would be 1 as a uint8_t, only the "1" would be left
+	strcpy(json, "{\"rules\":[{\"kind\":\"expr\",\"expr\":\"1");
+	char *spaces = json + strlen(json);
+	memset(spaces, ' ', 256);
+	strcpy(spaces + 256, "\"}]}");
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("{\"error_msg\":\"rules[0].expr: expression too long\"}", json);
+	strcpy(json, "{\"rules\":[{\"kind\":\"expr\",\"expr\":\"\"}]}");
+	rls_setRuleSetFromJson(0, json);
+	TEST_ASSERT_EQUAL_STRING("", json);
+	out.clear();
+	jw_init(&jw, &out, false, false);
+	rls_getRuleSetAsJson(0, &jw);
+	jw_end(&jw);
+	TEST_ASSERT_NOT_NULL(strstr(out.text, "\"rules\":[]"));
+}
+
+void test_arbiter(void) {
+	strcpy(json, ruleset);
+	rls_setRuleSetFromJson(0, json);
+	checkAt(29);
+	TEST_ASSERT_EQUAL(ARB_RULE, gen_getSource(FAN_IN));
+	// a timer goes before a rule, when its period has passed the rule is back
+	arb_request(ARB_TIMER, FAN_IN, 1609502400 + 60);
+	tick(1609502400 + 1);
+	TEST_ASSERT_EQUAL(ARB_TIMER, gen_getSource(FAN_IN));
+	TEST_ASSERT_EQUAL(1609502400 + 60, gen_getEndTime(FAN_IN));
+	delay(60000);
+	tick(1609502400 + 61);
+	TEST_ASSERT_EQUAL(ARB_RULE, gen_getSource(FAN_IN));
+	TEST_ASSERT_EQUAL(-2, gen_getEndTime(FAN_IN));
+	// in manual mode it keeps its state and only the requests by hand count
+	gen_setDeviceToManual(FAN_IN, true);
+	tick(1609502400 + 62);
+	TEST_ASSERT_EQUAL(ARB_MANUAL, gen_getSource(FAN_IN));
+	TEST_ASSERT_EQUAL(-1, gen_getEndTime(FAN_IN));
+	arb_request(ARB_MANUAL, FAN_IN, 0);
+	arb_request(ARB_TIMER, FAN_IN, -1);
+	tick(1609502400 + 63);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_IN));
+	arb_release(ARB_TIMER, FAN_IN);
+	gen_setDeviceToManual(FAN_IN, false);
+	tick(1609502400 + 64);
+	TEST_ASSERT_EQUAL(ARB_RULE, gen_getSource(FAN_IN));
+	// in auto mode off by hand lasts until another source changes its request
+	arb_request(ARB_MANUAL, FAN_IN, 0);
+	tick(1609502400 + 64);
+	tick(1609502400 + 64);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(FAN_IN));
+	arb_request(ARB_TIMER, FAN_IN, -1);
+	tick(1609502400 + 64);
+	TEST_ASSERT_EQUAL(ARB_TIMER, gen_getSource(FAN_IN));
+	TEST_ASSERT_FALSE(arb_hasRequest(ARB_MANUAL, FAN_IN));
+	arb_release(ARB_TIMER, FAN_IN);
+	tick(1609502400 + 64);
+	TEST_ASSERT_EQUAL(ARB_RULE, gen_getSource(FAN_IN));
+	// a tick without new requests writes nothing
+	uint16_t version = gen_getVersion();
+	tick(1609502400 + 65);
+	TEST_ASSERT_EQUAL(version, gen_getVersion());
+	// the period ended within one tick, until the loop stalls
+	TEST_ASSERT_EQUAL(1, arb_getMaxDelay());
+	arb_request(ARB_TIMER, LIGHT1, 1609502400 + 70);
+	arb_request(ARB_TIMER, LIGHT2, 1609502400 + 90);
+	tick(1609502400 + 66);
+	delay(9000);
+	tick(1609502400 + 75);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(LIGHT1));
+	TEST_ASSERT_TRUE(gen_isDeviceOn(LIGHT2));
+	TEST_ASSERT_EQUAL(5, arb_getMaxDelay());
+	delay(16000);
+	tick(1609502400 + 91);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(LIGHT2));
+	// a clock that is set forward drops the request but is no delay of the loop
+	arb_request(ARB_TIMER, LIGHT1, 1609502400 + 100);
+	delay(1000);
+	tick(1609502400 + 92);
+	tick(1609502400 + 100000);
+	TEST_ASSERT_FALSE(gen_isDeviceOn(LIGHT1));
+	TEST_ASSERT_EQUAL(5, arb_getMaxDelay());
+}
+
+void test_sprayer_rule_runs(void) {
+	strcpy(json, "{\"delay\":0,\"actions\":[{\"device\":\"fan_in\",\"on_period\":600}]}");
+	rls_setSprayerRuleFromJson(json);
+	arb_request(ARB_MANUAL, SPRAYER, 1609502400 + 5);
+	arb_tick(1609502400);
+	rls_checkSprayerRule(1609502400);
+	arb_tick(1609502400 + 6); // the sprayer goes off
+	rls_checkSprayerRule(1609502400 + 7);
+	TEST_ASSERT_TRUE(rls_isSprayerRuleActive());
+	rls_checkSprayerRule(1609502400 + 8);
+	arb_tick(1609502400 + 8);
+	TEST_ASSERT_EQUAL(ARB_SPRAYER, gen_getSource(FAN_IN));
+	TEST_ASSERT_EQUAL(1609502400 + 608, gen_getEndTime(FAN_IN));
+}
+
+void test_device_ids(void) {
+	TEST_ASSERT_EQUAL(SPRAYER, gen_getDeviceId("sprayer", 7));
+	TEST_ASSERT_EQUAL(NO_DEVICE, gen_getDeviceId("no device", 9));
+	TEST_ASSERT_EQUAL(UNKNOWN_DEVICE, gen_getDeviceId("spray", 5));
+	TEST_ASSERT_EQUAL(UNKNOWN_DEVICE, gen_getDeviceId("mist", 4));
+	for (int8_t d = 0; d < NR_OF_DEVICES; d++) {
+		const char *name = gen_getDevices()[d].name;
+		TEST_ASSERT_EQUAL(d, gen_getDeviceId(name, strlen(name)));
+	}
+}
+
+/*****************************************************************
+    Public functions (templates in the corresponding header-file)
+******************************************************************/
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_ruleset_round_trip);
+	RUN_TEST(test_ruleset_rejected);
+	RUN_TEST(test_ruleset_put_replaces_arrays);
+	RUN_TEST(test_rulesets_share_eeprom);
+	RUN_TEST(test_rulesets_of_older_layout);
+	RUN_TEST(test_sprayer_rule_round_trip);
+	RUN_TEST(test_timer);
+	RUN_TEST(test_timers_of_older_layout);
+	RUN_TEST(test_timer_events);
+	RUN_TEST(test_timer_put_after_pulse);
+	RUN_TEST(test_timer_recurrence);
+	RUN_TEST(test_cbor_tags);
+	RUN_TEST(test_cbor_media_type);
+	RUN_TEST(test_temperature_rules);
+	RUN_TEST(test_rules_follow_changes);
+	RUN_TEST(test_ruleset_put_releases_rules);
+	RUN_TEST(test_hysteresis_rule);
+	RUN_TEST(test_rate_rule);
+	RUN_TEST(test_rule_params_of_eeprom);
+	RUN_TEST(test_pid_rule);
+	RUN_TEST(test_expr_rule);
+	RUN_TEST(test_arbiter);
+	RUN_TEST(test_sprayer_rule_runs);
+	RUN_TEST(test_device_ids);
+	return UNITY_END();
+}